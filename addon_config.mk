@@ -28,6 +28,8 @@ common:
 
     # defines that will be passed to the compiler when including this addon
 	ADDON_DEFINES = OF_ADDON_HAS_OFX_ORBBEC
+	# MJPG color / IR is decoded with libjpeg-turbo - swap for OFXORBBEC_USE_OPENCV_JPEG ( and drop the libturbojpeg lines below ) to use cv::imdecode, Linux only
+	ADDON_DEFINES += OFXORBBEC_USE_TURBOJPEG
 
 	# include search paths, this will be usually parsed from the file system
 	# but if the addon or addon libraries need special search paths they can be
@@ -63,3 +65,25 @@ common:
 	# a specific platform
 	# ADDON_LIBS_EXCLUDE =
 
+linux64:
+	# sudo apt install libturbojpeg0-dev
+	ADDON_PKG_CONFIG_LIBRARIES = libturbojpeg
+
+linuxarmv6l:
+	ADDON_PKG_CONFIG_LIBRARIES = libturbojpeg
+
+linuxarmv7l:
+	ADDON_PKG_CONFIG_LIBRARIES = libturbojpeg
+
+linuxaarch64:
+	ADDON_PKG_CONFIG_LIBRARIES = libturbojpeg
+
+osx:
+	# brew install jpeg-turbo - Apple silicon and Intel prefixes
+	ADDON_INCLUDES += /opt/homebrew/opt/jpeg-turbo/include /usr/local/opt/jpeg-turbo/include
+	ADDON_LDFLAGS += -L/opt/homebrew/opt/jpeg-turbo/lib -L/usr/local/opt/jpeg-turbo/lib -lturbojpeg
+
+vs:
+	# the libjpeg-turbo installer's default location - copy turbojpeg.dll next to your exe
+	ADDON_INCLUDES += C:/libjpeg-turbo64/include
+	ADDON_LIBS += C:/libjpeg-turbo64/lib/turbojpeg.lib
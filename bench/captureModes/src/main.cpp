@@ -0,0 +1,85 @@
+#include "ofMain.h"
+#include "ofxOrbbecCamera.h"
+
+// Replays the same recording with CAPTURE_POLL and CAPTURE_CALLBACK and prints what each costs.
+// usage: captureModes recording.bag [seconds per mode] [threaded streams 0 / 1]
+// Playback runs at the recorded rate so both modes see the same input - compare latency and capture thread CPU, not fps.
+
+struct ModeResult{
+    std::string name;
+    uint64_t numFrameSets = 0;
+    ofxOrbbec::CaptureStats stats;
+    ofxOrbbec::ThreadStats captureThread;
+};
+
+static ModeResult runMode(const std::string & file, ofxOrbbec::CaptureMode mode, float seconds, bool bThreaded){
+    ofxOrbbec::Settings settings;
+    settings.playbackFile = file;
+    settings.bDepth = true;
+    settings.bColor = true;
+    settings.bPointCloud = true;
+    settings.captureMode = mode;
+    settings.bThreadedStreams = bThreaded;
+
+    ModeResult result;
+    result.name = mode == ofxOrbbec::CAPTURE_POLL ? "poll" : "callback";
+
+    ofxOrbbecCamera cam;
+    if( !cam.open(settings) ){
+        ofLogError("captureModes") << " couldn't open " << file;
+        return result;
+    }
+
+    //every frameset, so a consumer that's slow to wake shows up in the count
+    ofxOrbbec::SubscriptionSettings subSettings;
+    subSettings.mode = ofxOrbbec::SUBSCRIBE_QUEUE;
+    subSettings.queueSize = 64;
+    auto subscription = cam.subscribe(subSettings);
+
+    uint64_t endUs = ofGetElapsedTimeMicros() + (uint64_t)(seconds * 1000000.0f);
+    ofxOrbbec::FrameSetRef frameSet;
+    while( ofGetElapsedTimeMicros() < endUs ){
+        if( subscription->receive(frameSet, 100) ){
+            result.numFrameSets++;
+        }
+    }
+
+    result.stats = cam.getCaptureStats();
+    for(auto & thread : cam.getThreadStats()){
+        if( ofIsStringInString(thread.name, "capture") ){
+            result.captureThread = thread;
+        }
+    }
+    cam.close();
+    return result;
+}
+
+static void printResult(const ModeResult & r, float seconds){
+    auto printStream = [](const std::string & name, const ofxOrbbec::StreamStats & s){
+        std::cout << "    " << name << ": " << s.numFrames << " frames, latency avg " << s.avgLatencyMs << " ms, max " << s.maxLatencyMs << " ms, dropped " << s.numDropped << std::endl;
+    };
+    std::cout << r.name << ": " << r.numFrameSets << " framesets received ( " << r.numFrameSets / seconds << " / s )" << std::endl;
+    printStream("depth", r.stats.depth);
+    printStream("color", r.stats.color);
+    std::cout << "    capture thread: " << r.captureThread.cpuTimeMs << " ms CPU, " << r.captureThread.cpuUsage * 100.0f << "% of a core" << std::endl;
+}
+
+//========================================================================
+int main(int argc, char ** argv){
+    if( argc < 2 ){
+        std::cout << "usage: " << argv[0] << " recording.bag [seconds per mode] [threaded streams 0 / 1]" << std::endl;
+        return 1;
+    }
+    ofInit();
+
+    std::string file = argv[1];
+    float seconds = argc > 2 ? ofToFloat(argv[2]) : 10.0f;
+    bool bThreaded = argc > 3 && ofToInt(argv[3]) != 0;
+
+    auto poll = runMode(file, ofxOrbbec::CAPTURE_POLL, seconds, bThreaded);
+    auto callback = runMode(file, ofxOrbbec::CAPTURE_CALLBACK, seconds, bThreaded);
+
+    printResult(poll, seconds);
+    printResult(callback, seconds);
+    return poll.numFrameSets && callback.numFrameSets ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+// Times depthToPreview() against the OpenCV threshold + convertTo path it replaced and checks they give the same pixels.
+// No openFrameworks needed:
+//   g++ -O3 -march=native -std=c++17 -I../../src main.cpp ../../src/ofxOrbbecConversions.cpp $(pkg-config --cflags --libs opencv4) -o depthPreview
+// usage: depthPreview [iterations]
+
+#include "ofxOrbbecConversions.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+//what processFrame did before - clip at 5460 mm then scale into 8 bits, with persistent scratch mats
+static void openCVPreview(const uint16_t * src, int width, int height, float valueScale, cv::Mat & clipped, uint8_t * dst){
+    cv::Mat rawMat(height, width, CV_16UC1, (void *)src);
+    cv::Mat dstMat(height, width, CV_8UC1, dst);
+    cv::threshold(rawMat, clipped, 5460.0f / valueScale, 0, cv::THRESH_TRUNC);
+    clipped.convertTo(dstMat, CV_8UC1, valueScale * 0.05);
+}
+
+template <typename Func>
+static double timeMs(int iterations, Func func){
+    func();
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; i++){
+        func();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+int main(int argc, char ** argv){
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 500;
+
+    //common Orbbec depth modes
+    const int sizes[][2] = {{320, 288}, {640, 576}, {512, 512}, {1024, 1024}, {1280, 800}};
+    const uint8_t invalidColor[3] = {0, 0, 0};
+    const float valueScale = 1.0f;
+
+    //a mix of no depth, in range and beyond the clip
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> dist(0, 7000);
+
+    cv::setNumThreads(1);
+    std::cout << "size          opencv ms   fused ms   speedup   mismatched pixels" << std::endl;
+
+    for(auto & size : sizes){
+        int w = size[0], h = size[1];
+        size_t n = (size_t)w * h;
+        std::vector <uint16_t> depth(n);
+        for(auto & d : depth){
+            int v = dist(rng);
+            d = v < 500 ? 0 : v;
+        }
+        std::vector <uint8_t> outCV(n), outFused(n);
+        cv::Mat clipped;
+
+        double cvMs = timeMs(iterations, [&]{
+            openCVPreview(depth.data(), w, h, valueScale, clipped, outCV.data());
+        });
+        //the defaults - 0 to 5100 mm, grey, black for no depth - are the old mapping
+        double fusedMs = timeMs(iterations, [&]{
+            ofxOrbbec::depthToPreview(depth.data(), n, valueScale, 0.0f, 5100.0f, ofxOrbbec::DEPTH_COLORMAP_GREY, invalidColor, outFused.data());
+        });
+
+        //convertTo and the kernel can round a .5 differently - allow 1
+        size_t numMismatched = 0;
+        for(size_t i = 0; i < n; i++){
+            if( std::abs((int)outCV[i] - (int)outFused[i]) > 1 ){
+                numMismatched++;
+            }
+        }
+
+        std::cout << w << "x" << h << "\t" << cvMs << "\t" << fusedMs << "\t" << cvMs / fusedMs << "x\t" << numMismatched << std::endl;
+    }
+    return 0;
+}
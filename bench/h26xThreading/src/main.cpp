@@ -0,0 +1,151 @@
+#include "ofMain.h"
+#include "ofxOrbbecH26XDecoder.h"
+
+// Decodes a raw H.264 / H.265 elementary stream ( Annex B, ie: ffmpeg -i in.mp4 -c copy -bsf:v hevc_mp4toannexb out.h265 )
+// with each H26XSettings threading mode and prints throughput and packet to picture latency.
+// usage: h26xThreading stream.h265 [fps to pace the latency run at]
+// Needs OFXORBBEC_DECODE_H264_H265 and the ffmpeg libs, same as the addon.
+
+#ifdef OFXORBBEC_DECODE_H264_H265
+
+struct Mode{
+    std::string name;
+    int threadCount;
+    ofxOrbbec::H26XThreading threading;
+    bool bLowDelay;
+};
+
+struct ModeResult{
+    uint64_t numPictures = 0;
+    double seconds = 0.0;
+    ofxOrbbec::H26XStats stats;
+};
+
+//cuts the stream into the packets the camera would send, one access unit each
+static std::vector <std::vector<uint8_t>> splitPackets(const ofBuffer & stream, bool bH264){
+    std::vector <std::vector<uint8_t>> packets;
+    const AVCodec * codec = avcodec_find_decoder(bH264 ? AV_CODEC_ID_H264 : AV_CODEC_ID_H265);
+    AVCodecParserContext * parser = av_parser_init(codec->id);
+    AVCodecContext * context = avcodec_alloc_context3(codec);
+
+    const uint8_t * data = (const uint8_t *)stream.getData();
+    size_t remaining = stream.size();
+    //a last empty call flushes the final access unit
+    while( true ){
+        uint8_t * out = nullptr;
+        int outSize = 0;
+        int used = av_parser_parse2(parser, context, &out, &outSize, data, (int)remaining, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+        if( used < 0 ){
+            break;
+        }
+        if( outSize > 0 ){
+            packets.emplace_back(out, out + outSize);
+        }
+        if( remaining == 0 ){
+            if( outSize == 0 ){
+                break;
+            }
+            continue;
+        }
+        data += used;
+        remaining -= used;
+    }
+
+    avcodec_free_context(&context);
+    av_parser_close(parser);
+    return packets;
+}
+
+//intervalUs 0 sends packets as fast as the decoder takes them - for throughput. Otherwise they arrive at the camera's rate - for latency
+static ModeResult runMode(const Mode & mode, const std::vector <std::vector<uint8_t>> & packets, bool bH264, uint64_t intervalUs){
+    ofxOrbbec::H26XSettings settings;
+    settings.threadCount = mode.threadCount;
+    settings.threading = mode.threading;
+    settings.bLowDelay = mode.bLowDelay;
+
+    ofxOrbbec::H26XDecoder decoder;
+    decoder.setup(settings);
+
+    //convert like the addon does so the scaler cost is in the numbers
+    ofPixels pix;
+    ModeResult result;
+    auto onPicture = [&](const ofxOrbbec::H26XPicture & picture){
+        decoder.convert(picture, OF_PIXELS_RGB, pix);
+        result.numPictures++;
+    };
+
+    uint64_t startUs = ofGetElapsedTimeMicros();
+    uint64_t seq = 0;
+    for(auto & data : packets){
+        if( intervalUs ){
+            uint64_t dueUs = startUs + seq * intervalUs;
+            while( ofGetElapsedTimeMicros() < dueUs ){
+                ofSleepMillis(1);
+            }
+        }
+        ofxOrbbec::H26XPacket packet;
+        packet.data = data.data();
+        packet.size = data.size();
+        packet.bH264 = bH264;
+        packet.seq = ++seq;
+        packet.index = seq;
+        packet.pushTimeUs = ofGetElapsedTimeMicros();
+        decoder.decode(packet, onPicture);
+    }
+    //the pictures frame threading still holds count too
+    decoder.drain(onPicture);
+    result.seconds = (ofGetElapsedTimeMicros() - startUs) / 1000000.0;
+    result.stats = decoder.getStats();
+    return result;
+}
+
+//========================================================================
+int main(int argc, char ** argv){
+    if( argc < 2 ){
+        std::cout << "usage: " << argv[0] << " stream.h265 [fps to pace the latency run at]" << std::endl;
+        return 1;
+    }
+    ofInit();
+
+    std::string path = argv[1];
+    std::string ext = ofToLower(ofFilePath::getFileExt(path));
+    bool bH264 = ext == "h264" || ext == "264";
+    float fps = argc > 2 ? ofToFloat(argv[2]) : 30.0f;
+
+    ofBuffer stream = ofBufferFromFile(path, true);
+    auto packets = splitPackets(stream, bH264);
+    if( packets.empty() ){
+        ofLogError("h26xThreading") << " no packets in " << path;
+        return 1;
+    }
+    std::cout << path << ": " << packets.size() << " packets, " << ( bH264 ? "H.264" : "H.265" ) << std::endl;
+
+    int cores = std::thread::hardware_concurrency();
+    std::vector <Mode> modes = {
+        {"1 thread", 1, ofxOrbbec::H26X_THREADS_SLICE, false},
+        {"1 thread, low delay", 1, ofxOrbbec::H26X_THREADS_SLICE, true},
+        {ofToString(cores) + " threads, slice", 0, ofxOrbbec::H26X_THREADS_SLICE, false},
+        {ofToString(cores) + " threads, frame", 0, ofxOrbbec::H26X_THREADS_FRAME, false},
+        {ofToString(cores) + " threads, frame + slice", 0, ofxOrbbec::H26X_THREADS_FRAME_AND_SLICE, false},
+        {ofToString(cores) + " threads, frame, low delay", 0, ofxOrbbec::H26X_THREADS_FRAME, true},
+    };
+
+    for(auto & mode : modes){
+        auto throughput = runMode(mode, packets, bH264, 0);
+        auto paced = runMode(mode, packets, bH264, (uint64_t)(1000000.0f / fps));
+
+        std::cout << mode.name << std::endl;
+        std::cout << "    throughput: " << throughput.numPictures / throughput.seconds << " pictures / s ( " << throughput.numPictures << " of " << packets.size() << " )" << std::endl;
+        std::cout << "    at " << fps << " fps: latency avg " << paced.stats.avgLatencyMs << " ms, max " << paced.stats.maxLatencyMs << " ms, " << paced.stats.numErrors << " errors" << std::endl;
+    }
+    return 0;
+}
+
+#else
+
+int main(){
+    std::cout << "define OFXORBBEC_DECODE_H264_H265 in ofxOrbbecH26XDecoder.h" << std::endl;
+    return 1;
+}
+
+#endif
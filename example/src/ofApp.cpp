@@ -11,10 +11,14 @@ void ofApp::setup(){
     settings.bPointCloud = true; 
     //settings.depthFrameSize.format = OB_FORMAT_Y16;
     //settings.depthFrameSize.requestWidth = 640; //For Femto: 512 is WFOV binned, 640 is NFOV, 320 is NFOV binned 
+    //settings.depthPreviewColormap = ofxOrbbec::DEPTH_COLORMAP_TURBO; 
+    //settings.depthPreviewFar = 3000; //mm
     settings.colorFrameSize.format = OB_FORMAT_MJPG; 
     settings.colorFrameSize.requestWidth = 1280;
     //settings.bPointCloudRGB = true; 
     //settings.ip = "192.168.50.70";
+    //settings.captureMode = ofxOrbbec::CAPTURE_CALLBACK; //process frames on the SDK thread as soon as they arrive
+    //settings.bThreadedStreams = true; //decode color on its own thread so it never holds up depth
     
     orbbecCam.open(settings);
     
@@ -26,15 +30,16 @@ void ofApp::update(){
     orbbecCam.update();
     
     if( orbbecCam.isFrameNewColor() ){
-        auto pix = orbbecCam.getColorPixels(); 
+        const auto & pix = orbbecCam.getColorPixels(); 
         outputTex.loadData(pix);
     }
 
     if( orbbecCam.isFrameNewDepth() ){
-        auto depthPix = orbbecCam.getDepthPixels();
+        const auto & depthPix = orbbecCam.getDepthPixels();
         outputTexDepth.loadData(depthPix);
 
-        mPointCloudMesh = orbbecCam.getPointCloudMesh();
+        //hold a lease instead of copying the mesh - it stays valid until we replace it
+        mPointCloud = orbbecCam.getPointCloudFrame();
     }
 
 }
@@ -59,7 +64,9 @@ void ofApp::draw(){
     mCam.begin();
         ofPushMatrix();
         ofTranslate(0, -300, 1000);
-        mPointCloudMesh.draw(); 
+        if( mPointCloud ){
+            mPointCloud->data.mesh.draw(); 
+        }
         ofPopMatrix();
     mCam.end();
     ofDisableDepthTest();
@@ -25,7 +25,7 @@ class ofApp : public ofBaseApp{
 		void dragEvent(ofDragInfo dragInfo);
 		void gotMessage(ofMessage msg);
 		
-		ofMesh mPointCloudMesh;
+		ofxOrbbec::FrameRef <ofxOrbbec::PointCloudData> mPointCloud;
 
 		ofxOrbbecCamera orbbecCam; 
 		ofxOrbbec::Settings settings; 
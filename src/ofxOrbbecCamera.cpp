@@ -1,6 +1,49 @@
 
 #include "ofxOrbbecCamera.h"
 #include <libobsensor/hpp/Utils.hpp>
+#include "ofxOrbbecConversions.h"
+
+template <typename T>
+static void setFrameInfo(ofxOrbbec::FrameData<T> & dst, shared_ptr<ob::Frame> src){
+    dst.index = src->index();
+    dst.timeStampUs = src->timeStampUs();
+    dst.systemTimeStampUs = src->systemTimeStampUs();
+}
+
+static OBSensorType getIRSensorType(ofxOrbbec::IRStream stream){
+    return stream == ofxOrbbec::IR_LEFT ? OB_SENSOR_IR_LEFT : stream == ofxOrbbec::IR_RIGHT ? OB_SENSOR_IR_RIGHT : OB_SENSOR_IR;
+}
+
+static OBFrameType getIRFrameType(ofxOrbbec::IRStream stream){
+    return stream == ofxOrbbec::IR_LEFT ? OB_FRAME_IR_LEFT : stream == ofxOrbbec::IR_RIGHT ? OB_FRAME_IR_RIGHT : OB_FRAME_IR;
+}
+
+static const char * getIRStreamName(ofxOrbbec::IRStream stream){
+    return stream == ofxOrbbec::IR_LEFT ? "ir left" : stream == ofxOrbbec::IR_RIGHT ? "ir right" : "ir";
+}
+
+//4:2:x YUV crops start on an even column so chroma pairs stay together, RGB can start anywhere
+static size_t getColorAlignX(OBFormat format){
+    return format == OB_FORMAT_NV21 || format == OB_FORMAT_YUYV || format == OB_FORMAT_YUY2 || format == OB_FORMAT_UYVY ? 2 : 1;
+}
+
+//uses up one frame of the last getter read - false once there are none left
+static bool takePullFrame(std::atomic <int> & framesLeft){
+    int left = framesLeft;
+    while( left > 0 && !framesLeft.compare_exchange_weak(left, left - 1) ){
+    }
+    return left > 0;
+}
+
+static ofxOrbbec::PixelLayout toPixelLayout(ofPixelFormat format){
+    if( format == OF_PIXELS_BGR ){
+        return ofxOrbbec::LAYOUT_BGR;
+    }
+    if( format == OF_PIXELS_RGBA ){
+        return ofxOrbbec::LAYOUT_RGBA;
+    }
+    return ofxOrbbec::LAYOUT_RGB;
+}
 
 
 std::vector < std::shared_ptr<ob::DeviceInfo> > ofxOrbbecCamera::getDeviceList(bool bNetIncDevices){
@@ -33,16 +76,6 @@ std::vector < std::shared_ptr<ob::DeviceInfo> > ofxOrbbecCamera::getDeviceList(b
 //Class functions 
 ofxOrbbecCamera::~ofxOrbbecCamera(){
     close();
-    #ifdef OFXORBBEC_DECODE_H264_H265
-        if(bInitOneTime){
-            avcodec_close(codecContext264);
-            av_free(codecContext264);
-
-            avcodec_close(codecContext265);
-            av_free(codecContext265);
-            bInitOneTime = false; 
-        }
-    #endif 
 }
 
 void ofxOrbbecCamera::close(){
@@ -58,21 +91,89 @@ void ofxOrbbecCamera::clear(){
 		if( mPipe ){	
 			mPipe->stop();
 			mPipe.reset();
-			pointCloud.reset();
         }
     }catch(ob::Error &e) {
         std::cerr << "function:" << e.getName() << "\nargs:" << e.getArgs() << "\nmessage:" << e.getMessage() << "\ntype:" << e.getExceptionType() << std::endl;
     }
 
+    //after the pipe is stopped nothing else can be pushed to the workers
+    mDepthWorker.stop();
+    mColorWorker.stop();
+    mColorDecodePool.stop();
+    mJpegDecoders.clear();
+    mH26XWorker.stop();
+    mH26XDecoder.close();
+    mH26XSeq = 0;
+    //framesets still waiting on a picture are dropped with the decoder
+    mH26XPending.clear();
+    mH26XLastSeq = 0;
+    mH26XFinishSeq = 1;
+    mCaptureThreadHandle.reset();
+
+    {
+        std::unique_lock<std::mutex> lck(mFrameSetWaitMutex);
+        mLatestFrameSet.reset();
+    }
+
     mCurrentSettings = ofxOrbbec::Settings();
     bNewFrameColor = bNewFrameDepth = bNewFrameIR = false;
-    mInternalColorFrameNo = mInternalDepthFrameNo = 0;
-    mExtColorFrameNo = mExtDepthFrameNo = 0;
+    mInternalColorFrameNo = 0;
+    mColorPullFrames = 0;
+    mDepthFloatPullFrames = 0;
+    mInternalDepthFrameNo = 0;
+    mInternalIRFrameNo = 0;
+    mExtColorFrameNo = mExtDepthFrameNo = mExtIRFrameNo = 0;
+    mCaptureStats = ofxOrbbec::CaptureStats();
+    mDepthProfileChoice = ofxOrbbec::ProfileChoice();
+    mColorProfileChoice = ofxOrbbec::ProfileChoice();
 
     mPipe.reset();
 	ctxLocal.reset();
     bConnected = false; 
+    xyTables = OBXYTables();
+    xyTableData.clear();
     mTimeSinceFrame = 0.0;
+
+    //frames still leased by the app stay valid until they are released - the ones behind the reference getters are ours
+    mDepthPixelsLease.reset();
+    mDepthRawLease.reset();
+    mDepthFloatLease.reset();
+    mColorPixelsLease.reset();
+    mPointCloudLease.reset();
+    mPointCloudMeshLease.reset();
+    mDepthBuffer.reset();
+    mDepthRawBuffer.reset();
+    mDepthFloatBuffer.reset();
+    mColorBuffer.reset();
+    mColorPlanesBuffer.reset();
+    mPointCloudBuffer.reset();
+    mFrameSetBuffer.reset();
+    mFrameSetPool.clear();
+    mDepthPool.clear();
+    mDepthRawPool.clear();
+    mDepthFloatPool.clear();
+    mColorPool.clear();
+    mColorPlanesPool.clear();
+    mCompressedPool.clear();
+    mPointCloudPool.clear();
+    for(int i = 0; i < ofxOrbbec::IR_NUM_STREAMS; i++){
+        mIRPixelsLease[i].reset();
+        mIRRawLease[i].reset();
+    }
+    for(auto & ir : mIR){
+        ir.buffer.reset();
+        ir.rawBuffer.reset();
+        ir.pool.clear();
+        ir.rawPool.clear();
+        ir.autoGain = ofxOrbbec::AutoGainState();
+        ir.profile = ofxOrbbec::ProfileChoice();
+    }
+    for(int i = 0; i < ofxOrbbec::PYRAMID_NUM_LEVELS; i++){
+        mColorPyramid.buffer[i].reset();
+        mColorPyramid.pool[i].clear();
+        mDepthPyramid.buffer[i].reset();
+        mDepthPyramid.pool[i].clear();
+    }
 }
 
 bool ofxOrbbecCamera::open(ofxOrbbec::Settings aSettings){
@@ -91,9 +192,36 @@ bool ofxOrbbecCamera::open(ofxOrbbec::Settings aSettings){
         aSettings.bDepth = true; 
     }
 
+    if( aSettings.colorPixelFormat != OF_PIXELS_RGB && aSettings.colorPixelFormat != OF_PIXELS_BGR && aSettings.colorPixelFormat != OF_PIXELS_RGBA ){
+        ofLogWarning("ofxOrbbecCamera::open") << " colorPixelFormat must be OF_PIXELS_RGB, OF_PIXELS_BGR or OF_PIXELS_RGBA - using OF_PIXELS_RGB ";
+        aSettings.colorPixelFormat = OF_PIXELS_RGB;
+    }
+    if( aSettings.mjpgDecodeScale != 1 && aSettings.mjpgDecodeScale != 2 && aSettings.mjpgDecodeScale != 4 && aSettings.mjpgDecodeScale != 8 ){
+        ofLogWarning("ofxOrbbecCamera::open") << " mjpgDecodeScale must be 1, 2, 4 or 8 - using 1 ";
+        aSettings.mjpgDecodeScale = 1;
+    }
+    if( aSettings.bPointCloudRGB && aSettings.h26x.output == ofxOrbbec::H26X_OUTPUT_PLANES ){
+        ofLogWarning("ofxOrbbecCamera::open") << " bPointCloudRGB needs color pixels - using H26X_OUTPUT_PIXELS_AND_PLANES ";
+        aSettings.h26x.output = ofxOrbbec::H26X_OUTPUT_PIXELS_AND_PLANES;
+    }
+    aSettings.colorPyramidLevels = ofClamp(aSettings.colorPyramidLevels, 0, ofxOrbbec::PYRAMID_NUM_LEVELS);
+    aSettings.depthPyramidLevels = ofClamp(aSettings.depthPyramidLevels, 0, ofxOrbbec::PYRAMID_NUM_LEVELS);
+
     mCurrentSettings = aSettings; 
+    mH26XDecoder.setup(aSettings.h26x);
 
-    if( aSettings.ip != ""){
+    if( aSettings.playbackFile != "" ){
+        //a recording opens its own pipeline and playback device
+        try{
+            mPipe = std::make_shared<ob::Pipeline>(ofToDataPath(aSettings.playbackFile, true).c_str());
+            device = mPipe->getDevice();
+        }catch(ob::Error &e) {
+            std::cerr << "function:" << e.getName() << "\nargs:" << e.getArgs() << "\nmessage:" << e.getMessage() << "\ntype:" << e.getExceptionType() << std::endl;
+        }
+        if(!device){
+            return false; 
+        }
+    }else if( aSettings.ip != ""){
         try{
             device = tCtx->createNetDevice(aSettings.ip.c_str(), 8090);
         }catch(ob::Error &e) {
@@ -138,7 +266,9 @@ bool ofxOrbbecCamera::open(ofxOrbbec::Settings aSettings){
 
     if( device ){
         // pass in device to create pipeline
-        mPipe = std::make_shared<ob::Pipeline>(device);
+        if( !mPipe ){
+            mPipe = std::make_shared<ob::Pipeline>(device);
+        }
     
         if( mPipe ){
 
@@ -148,52 +278,82 @@ bool ofxOrbbecCamera::open(ofxOrbbec::Settings aSettings){
 			shared_ptr<ob::StreamProfile> depthProfile;
 			shared_ptr<ob::StreamProfile> colorProfile;
 
-            if( aSettings.bDepth ){
-                // Get the depth camera configuration list
-                auto depthProfileList = mPipe->getStreamProfileList(OB_SENSOR_DEPTH);
-
-                if( mCurrentSettings.depthFrameSize.requestWidth > 0){
-                    try {
-                        auto requestType = mCurrentSettings.depthFrameSize;
+            //depth and color share the link so color only gets what depth leaves
+            std::string connectionType = device->getDeviceInfo()->connectionType();
+            float linkBudget = ofxOrbbec::getLinkBudgetMBs(connectionType);
+            bool bH26X = false;
+            #ifdef OFXORBBEC_DECODE_H264_H265
+                bH26X = true;
+            #endif
+            //cv::imdecode isn't there on every platform - never pick MJPG we'd fail to decode
+            bool bMJPG = ofxOrbbec::JpegDecoder::isAvailable();
 
-                        // Find the corresponding profile according to the specified format
-                        depthProfile = depthProfileList->getVideoStreamProfile(requestType.requestWidth, requestType.requestHeight, requestType.format, requestType.frameRate);
-                    }
-                    catch(ob::Error &e) {
-                        ofLogWarning("ofxOrbbecCamera::open") << " couldn't open depth with requested dimensions / format - using default "; 
-                        depthProfile = depthProfileList->getProfile(0);
-                    }
-
-                }else{  
-                    depthProfile = depthProfileList->getProfile(0);
+            if( aSettings.bDepth ){
+                ofxOrbbec::ProfileRequest request;
+                request.width = aSettings.depthFrameSize.requestWidth;
+                request.height = aSettings.depthFrameSize.requestHeight;
+                request.format = aSettings.depthFrameSize.format;
+                request.frameRate = aSettings.depthFrameSize.frameRate;
+
+                mDepthProfileChoice = ofxOrbbec::negotiateProfile(mPipe->getStreamProfileList(OB_SENSOR_DEPTH), OB_SENSOR_DEPTH, request, linkBudget, bH26X, bMJPG);
+                depthProfile = mDepthProfileChoice.profile;
+                if( !depthProfile ){
+                    ofLogError("ofxOrbbecCamera::open") << " depth: " << mDepthProfileChoice.reason;
+                    return false;
                 }
-                
+                ofLogNotice("ofxOrbbecCamera::open") << " depth ( " << connectionType << " ): " << mDepthProfileChoice.toString();
+                linkBudget = std::max(linkBudget - mDepthProfileChoice.bandwidthMBs, 0.0f);
+
                 // enable depth stream
                 config->enableStream(depthProfile);
             }
 
             if( aSettings.bColor ){
-                // Get the color camera configuration list
-                auto colorProfileList = mPipe->getStreamProfileList(OB_SENSOR_COLOR);
+                ofxOrbbec::ProfileRequest request;
+                request.width = aSettings.colorFrameSize.requestWidth;
+                request.height = aSettings.colorFrameSize.requestHeight;
+                request.format = aSettings.colorFrameSize.format;
+                request.frameRate = aSettings.colorFrameSize.frameRate;
+
+                mColorProfileChoice = ofxOrbbec::negotiateProfile(mPipe->getStreamProfileList(OB_SENSOR_COLOR), OB_SENSOR_COLOR, request, linkBudget, bH26X, bMJPG);
+                colorProfile = mColorProfileChoice.profile;
+                if( !colorProfile ){
+                    ofLogError("ofxOrbbecCamera::open") << " color: " << mColorProfileChoice.reason;
+                    return false;
+                }
+                ofLogNotice("ofxOrbbecCamera::open") << " color ( " << connectionType << " ): " << mColorProfileChoice.toString();
+                linkBudget = std::max(linkBudget - mColorProfileChoice.bandwidthMBs, 0.0f);
 
-                if( mCurrentSettings.colorFrameSize.requestWidth > 0){
-                    try {
-                        auto requestType = mCurrentSettings.colorFrameSize;
+                // enable color stream
+                config->enableStream(colorProfile);
+            }
 
-                        // Find the corresponding profile according to the specified format
-                        colorProfile = colorProfileList->getVideoStreamProfile(requestType.requestWidth, requestType.requestHeight, requestType.format, requestType.frameRate);
-                    }
-                    catch(ob::Error &e) {
-                        ofLogWarning("ofxOrbbecCamera::open") << " couldn't open color with requested dimensions / format - using default "; 
-                        colorProfile = colorProfileList->getProfile(0);
-                    }
+            for(int i = 0; i < ofxOrbbec::IR_NUM_STREAMS; i++){
+                auto stream = (ofxOrbbec::IRStream)i;
+                if( !isIREnabled(stream) ){
+                    continue;
+                }
 
-                }else{  
-                    colorProfile = colorProfileList->getProfile(0);
+                ofxOrbbec::ProfileRequest request;
+                request.width = aSettings.irFrameSize.requestWidth;
+                request.height = aSettings.irFrameSize.requestHeight;
+                request.format = aSettings.irFrameSize.format;
+                request.frameRate = aSettings.irFrameSize.frameRate;
+
+                auto & ir = mIR[stream];
+                try{
+                    ir.profile = ofxOrbbec::negotiateProfile(mPipe->getStreamProfileList(getIRSensorType(stream)), getIRSensorType(stream), request, linkBudget, bH26X, bMJPG);
+                }catch(ob::Error &e) {
+                    ir.profile.reason = "sensor not available on this device";
                 }
-                
-                // enable color stream
-                config->enableStream(colorProfile);
+                if( !ir.profile.profile ){
+                    ofLogError("ofxOrbbecCamera::open") << " " << getIRStreamName(stream) << ": " << ir.profile.reason;
+                    return false;
+                }
+                ofLogNotice("ofxOrbbecCamera::open") << " " << getIRStreamName(stream) << " ( " << connectionType << " ): " << ir.profile.toString();
+                linkBudget = std::max(linkBudget - ir.profile.bandwidthMBs, 0.0f);
+
+                config->enableStream(ir.profile.profile);
             }
 
             if( aSettings.bPointCloud ){
@@ -220,53 +380,218 @@ bool ofxOrbbecCamera::open(ofxOrbbec::Settings aSettings){
             }
             
 
-            // Pass in the configuration and start the pipeline
-            mPipe->start(config);
-            
-            if (device->isPropertySupported(OB_PROP_DEPTH_ROTATE_INT, OB_PERMISSION_WRITE)) {
-                device->setIntProperty(OB_PROP_DEPTH_ROTATE_INT, aSettings.rotation);
+            //size every output buffer now so steady state capture never allocates
+            //3 for the triple buffer plus one being written, more grow on demand while the app holds leases
+            size_t poolSize = std::max((size_t)4, aSettings.framePoolSize);
+            //H.26x color outputs are only filled when their frameset is published so they don't need the extra below
+            size_t leasePoolSize = poolSize;
+            //H.264 / H.265 framesets wait for their picture - one per frame the decoder holds back plus up to 16 reordered
+            bool bH26XColor = aSettings.bColor && colorProfile && ( colorProfile->format() == OB_FORMAT_H264 || colorProfile->format() == OB_FORMAT_H265 );
+            size_t h26xPending = 0;
+            if( bH26XColor ){
+                size_t h26xThreads = aSettings.h26x.threadCount > 0 ? aSettings.h26x.threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+                h26xPending = ( aSettings.h26x.threading == ofxOrbbec::H26X_THREADS_SLICE ? 1 : h26xThreads ) + 16;
+                poolSize += h26xPending;
+            }
+            //outputs are the size of their region
+            size_t depthW = 0, depthH = 0, colorW = 0, colorH = 0;
+            size_t cloudW = 0, cloudH = 0;
+            bool bColorDecodePool = false;
+            bool bColorFullFrame = true;
+            if( depthProfile ){
+                auto vsp = depthProfile->as<ob::VideoStreamProfile>();
+                auto region = ofxOrbbec::mapRegion(aSettings.depthRegion, vsp->width(), vsp->height());
+                depthW = region.outWidth;
+                depthH = region.outHeight;
+                cloudW = vsp->width();
+                cloudH = vsp->height();
+            }
+            if( colorProfile ){
+                auto vsp = colorProfile->as<ob::VideoStreamProfile>();
+                colorW = vsp->width();
+                colorH = vsp->height();
+                if( aSettings.bPointCloudRGB ){
+                    //depth is aligned to color so the cloud is on the color grid
+                    cloudW = colorW;
+                    cloudH = colorH;
+                }
+                if( vsp->format() == OB_FORMAT_MJPG ){
+                    bColorDecodePool = aSettings.mjpgDecodeThreads > 1;
+                    colorW = ofxOrbbec::JpegDecoder::getScaledSize(colorW, aSettings.mjpgDecodeScale);
+                    colorH = ofxOrbbec::JpegDecoder::getScaledSize(colorH, aSettings.mjpgDecodeScale);
+                }else if( vsp->format() != OB_FORMAT_H264 && vsp->format() != OB_FORMAT_H265 ){
+                    auto region = ofxOrbbec::mapRegion(aSettings.colorRegion, colorW, colorH, getColorAlignX(vsp->format()));
+                    bColorFullFrame = region.isFull(colorW, colorH);
+                    colorW = region.outWidth;
+                    colorH = region.outHeight;
+                }
+            }
+            if( aSettings.bPointCloudRGB && !bColorFullFrame && ( aSettings.colorRegion.x > 0 || aSettings.colorRegion.y > 0 || aSettings.colorRegion.width > 0 || aSettings.colorRegion.height > 0 ) ){
+                ofLogWarning("ofxOrbbecCamera::open") << " bPointCloudRGB samples the color output - crop with depthRegion, a cropped colorRegion will give the wrong colors ";
             }
 
-            if( aSettings.bPointCloud || aSettings.bPointCloudRGB ){
-                auto cameraParam = mPipe->getCameraParam();
+            if( aSettings.bDepth && aSettings.bDepthPreview ){
+                size_t previewChannels = ofxOrbbec::getNumChannels(aSettings.depthPreviewColormap);
+                mDepthPool.reserve(poolSize, [&](ofPixels & pix){ pix.allocate(depthW, depthH, previewChannels); });
+            }
+            if( aSettings.bDepth && aSettings.bDepthRaw ){
+                mDepthRawPool.reserve(poolSize, [&](ofShortPixels & pix){ pix.allocate(depthW, depthH, 1); });
+            }
+            if( aSettings.bDepth && aSettings.bDepthFloat ){
+                mDepthFloatPool.reserve(poolSize, [&](ofFloatPixels & pix){ pix.allocate(depthW, depthH, 1); });
+            }
+            //each level is half the one above
+            if( aSettings.bDepth ){
+                for(int i = 0; i < aSettings.depthPyramidLevels; i++){
+                    size_t levelW = depthW >> (i + 1), levelH = depthH >> (i + 1);
+                    mDepthPyramid.pool[i].reserve(poolSize, [&](ofShortPixels & pix){ pix.allocate(levelW, levelH, 1); });
+                }
+                mDepthStrip.resize(aSettings.depthPyramidLevels && !aSettings.bDepthRaw ? depthW * 4 : 0);
+            }
+            for(int i = 0; i < ofxOrbbec::IR_NUM_STREAMS; i++){
+                auto & ir = mIR[i];
+                if( !ir.profile.profile ){
+                    continue;
+                }
+                size_t irW = ir.profile.profile->width();
+                size_t irH = ir.profile.profile->height();
+                if( ir.profile.profile->format() != OB_FORMAT_MJPG ){
+                    auto region = ofxOrbbec::mapRegion(aSettings.irRegion, irW, irH);
+                    irW = region.outWidth;
+                    irH = region.outHeight;
+                }
+                if( aSettings.bIRPreview ){
+                    ir.pool.reserve(poolSize, [&](ofPixels & pix){ pix.allocate(irW, irH, 1); });
+                }
+                if( aSettings.bIRRaw ){
+                    ir.rawPool.reserve(poolSize, [&](ofShortPixels & pix){ pix.allocate(irW, irH, 1); });
+                }
+                ir.autoGain = ofxOrbbec::AutoGainState();
+                ir.autoGain.lowPercentile = aSettings.irGainLowPercentile;
+                ir.autoGain.highPercentile = aSettings.irGainHighPercentile;
+            }
 
-                pointCloud = std::make_shared<ob::PointCloudFilter>();
-                pointCloud->setCameraParam(cameraParam);
-                
-                if( aSettings.bPointCloudRGB ){
-                    pointCloud->setCreatePointFormat(OB_FORMAT_RGB_POINT);
-					auto param = mPipe->getCalibrationParam(config);
-										
-					auto     vsp            = colorProfile->as<ob::VideoStreamProfile>();
-					uint32_t colorWidth     = vsp->width();
-					uint32_t colorHeight    = vsp->height();
-					uint32_t tableSize = colorWidth * colorHeight * 2 * sizeof(float);
-					xyTableData.resize(tableSize);
-					
-					if(!ob::CoordinateTransformHelper::transformationInitXYTables(param, OB_SENSOR_COLOR, &xyTableData[0], &tableSize, &xyTables)) {
-						ofLogError() << " couldn't init xyTables for depth " << endl;
-					}
-					
-                }else{
-                    pointCloud->setCreatePointFormat(OB_FORMAT_POINT);
-                    
-					auto param = mPipe->getCalibrationParam(config);
-					auto     vsp            = depthProfile->as<ob::VideoStreamProfile>();
-					uint32_t depthWidth     = vsp->width();
-					uint32_t depthHeight    = vsp->height();
-					uint32_t tableSize = depthWidth * depthHeight * 2 * sizeof(float);
-					xyTableData.resize(tableSize);
-					
-					if(!ob::CoordinateTransformHelper::transformationInitXYTables(param, OB_SENSOR_DEPTH, &xyTableData[0], &tableSize, &xyTables)) {
-						ofLogError() << " couldn't init xyTables for depth " << endl;
-					}
+            //every decode thread can be holding a buffer plus one waiting to be delivered in order
+            //H.26x pictures are only converted into them when their frameset is published
+            size_t colorPoolSize = ( bH26XColor ? leasePoolSize : poolSize ) + (bColorDecodePool ? aSettings.mjpgDecodeThreads * 2 : 0);
+            if( bH26XColor && aSettings.h26x.output != ofxOrbbec::H26X_OUTPUT_PIXELS ){
+                //nothing to allocate - each one references a decoder buffer, handed back to the decoder once nobody holds the lease
+                mColorPlanesPool.reserve(leasePoolSize);
+                mColorPlanesPool.setRelease([](ofxOrbbec::FrameData<ofxOrbbec::YUVPlanes> & planes){
+                    ofxOrbbec::H26XDecoder::releasePlanes(planes.data, planes.source);
+                });
+            }
+            if( aSettings.bColor ){
+                bool bZeroCopy = aSettings.bColorZeroCopy && colorProfile && colorProfile->format() == OB_FORMAT_RGB && aSettings.colorPixelFormat == OF_PIXELS_RGB && bColorFullFrame;
+                if( aSettings.bColorZeroCopy && !bZeroCopy ){
+                    ofLogWarning("ofxOrbbecCamera::open") << " bColorZeroCopy needs OB_FORMAT_RGB color, OF_PIXELS_RGB output and the whole frame - copying instead ";
+                }
+                //H.26x planes only never converts, so there are no color pixels or pyramid to size
+                bool bColorPixels = !bH26XColor || aSettings.h26x.output != ofxOrbbec::H26X_OUTPUT_PLANES;
+                if( bZeroCopy ){
+                    //pixels will wrap the SDK frames so there is nothing to allocate
+                    mColorPool.reserve(colorPoolSize);
+                }else if( bColorPixels ){
+                    mColorPool.reserve(colorPoolSize, [&](ofPixels & pix){ pix.allocate(colorW, colorH, aSettings.colorPixelFormat); });
+                }
+                //wraps SDK frames for subscribeCompressed() - nothing to allocate
+                mCompressedPool.reserve(poolSize);
+                for(int i = 0; i < aSettings.colorPyramidLevels && bColorPixels; i++){
+                    size_t levelW = colorW >> (i + 1), levelH = colorH >> (i + 1);
+                    mColorPyramid.pool[i].reserve(colorPoolSize, [&](ofPixels & pix){ pix.allocate(levelW, levelH, aSettings.colorPixelFormat); });
+                }
+            }
+            if( aSettings.bPointCloud ){
+                bool bRGB = aSettings.bColor && aSettings.bPointCloudRGB;
+                auto region = ofxOrbbec::mapRegion(aSettings.depthRegion, cloudW, cloudH);
+                size_t numPoints = region.outWidth * region.outHeight;
+                mPointCloudPool.reserve(poolSize, [&](ofxOrbbec::PointCloudData & cloud){
+                    cloud.mesh.setMode(OF_PRIMITIVE_POINTS);
+                    cloud.mesh.getVertices().resize(numPoints);
+                    if( bRGB ){
+                        cloud.mesh.getColors().resize(numPoints);
+                    }
+                    cloud.points.resize(numPoints);
+                });
+            }
+            //plus the ones still queued on the workers
+            mFrameSetPool.reserve(colorPoolSize + (aSettings.bThreadedStreams || bColorDecodePool ? aSettings.streamQueueSize * 2 : 0) + (bH26XColor ? aSettings.h26x.queueSize : 0));
+
+            if( aSettings.bThreadedStreams ){
+                if( hasDepthStage() ){
+                    mDepthWorker.start(aSettings.threadName + " depth", aSettings.streamQueueSize, aSettings.streamDropPolicy, aSettings.processingThreads, [this](ofxOrbbec::StreamJob & job){
+                        processDepthFrameSet(job);
+                    });
+                }
+                if( aSettings.bColor && !bColorDecodePool ){
+                    mColorWorker.start(aSettings.threadName + " color", aSettings.streamQueueSize, aSettings.streamDropPolicy, aSettings.processingThreads, [this](ofxOrbbec::StreamJob & job){
+                        processColorFrameSet(job);
+                    });
+                }
+            }
+
+            //the decoder holds frames back so it gets its own thread whether or not the streams are threaded - it finishes
+            //each frameset's color stage once that frame's picture is out, so the other stages never wait on it
+            if( bH26XColor ){
+                mH26XPending.assign(h26xPending, ofxOrbbec::H26XJob());
+                mH26XWorker.start(aSettings.threadName + " h26x", std::max(aSettings.h26x.queueSize, (size_t)1), ofxOrbbec::DROP_OLDEST, aSettings.processingThreads, [this](ofxOrbbec::H26XJob & h26xJob){
+                    decodeH26XPacket(h26xJob);
+                });
+            }
 
+            if( aSettings.bColor && bColorDecodePool ){
+                for(size_t i = 0; i < aSettings.mjpgDecodeThreads; i++){
+                    mJpegDecoders.push_back(std::make_unique<ofxOrbbec::JpegDecoder>());
                 }
+                //deep enough that every thread has a frame waiting
+                size_t queueSize = std::max(aSettings.streamQueueSize, aSettings.mjpgDecodeThreads);
+                mColorDecodePool.start(aSettings.threadName + " mjpg", aSettings.mjpgDecodeThreads, queueSize, aSettings.streamDropPolicy, aSettings.processingThreads,
+                    [this](ofxOrbbec::StreamJob & job, size_t worker){
+                        decodeColor(job, *mJpegDecoders[worker]);
+                    },
+                    [this](ofxOrbbec::StreamJob & job){
+                        publishColor(job);
+                    });
+            }
+
+            if (device->isPropertySupported(OB_PROP_DEPTH_ROTATE_INT, OB_PERMISSION_WRITE)) {
+                device->setIntProperty(OB_PROP_DEPTH_ROTATE_INT, aSettings.rotation);
             }
 
+            //points are built from the calibration XY tables - on the color grid when depth is aligned to color
+            bool bColorGrid = aSettings.bPointCloudRGB && colorProfile;
+            auto gridProfile = bColorGrid ? colorProfile : depthProfile;
+            if( ( aSettings.bPointCloud || aSettings.bPointCloudRGB ) && gridProfile ){
+                auto vsp = gridProfile->as<ob::VideoStreamProfile>();
+                uint32_t tableSize = vsp->width() * vsp->height() * 2 * sizeof(float);
+                xyTableData.resize(tableSize);
+
+                auto param = mPipe->getCalibrationParam(config);
+                if(!ob::CoordinateTransformHelper::transformationInitXYTables(param, bColorGrid ? OB_SENSOR_COLOR : OB_SENSOR_DEPTH, &xyTableData[0], &tableSize, &xyTables)) {
+                    ofLogError() << " couldn't init xyTables for depth " << endl;
+                }
+            }
+
+            //everything the frame callbacks read is set up by now - in CAPTURE_CALLBACK mode frames can arrive before start() returns
+            if( aSettings.captureMode == ofxOrbbec::CAPTURE_CALLBACK ){
+                //frames are processed on the SDK's delivery thread as soon as they arrive
+                mPipe->start(config, [this](shared_ptr<ob::FrameSet> frameSet){
+                    if( !mCaptureThreadHandle.isSetup() ){
+                        mCaptureThreadHandle.setup(mCurrentSettings.threadName + " capture", mCurrentSettings.captureThread);
+                    }
+                    if( frameSet ){
+                        processFrameSet(frameSet);
+                    }
+                });
+            }else{
+                mPipe->start(config);
+            }
+            
             ob::Context::setLoggerSeverity(OB_LOG_SEVERITY_ERROR);
             bConnected = true; 
-            startThread();
+            if( aSettings.captureMode == ofxOrbbec::CAPTURE_POLL ){
+                startThread();
+            }
 
         }else{
             return false; 
@@ -284,29 +609,188 @@ bool ofxOrbbecCamera::isConnected(){
 	return false;
 }
 
-ofPixels ofxOrbbecCamera::getDepthPixels(){
+const ofPixels & ofxOrbbecCamera::getDepthPixels(){
+    mDepthPixelsLease = getDepthFrame();
+    return mDepthPixelsLease ? mDepthPixelsLease->data : mEmptyPixels;
+}
+
+const ofShortPixels & ofxOrbbecCamera::getDepthPixelsRaw(){
+    mDepthRawLease = getDepthRawFrame();
+    return mDepthRawLease ? mDepthRawLease->data : mEmptyShortPixels;
+}
+
+const ofFloatPixels & ofxOrbbecCamera::getDepthPixelsF(){
+    mDepthFloatLease = getDepthFloatFrame();
+    return mDepthFloatLease ? mDepthFloatLease->data : mEmptyFloatPixels;
+} 
+
+const ofPixels & ofxOrbbecCamera::getColorPixels(){
+    mColorPixelsLease = getColorFrame();
+    return mColorPixelsLease ? mColorPixelsLease->data : mEmptyPixels;
+}
+
+const ofPixels & ofxOrbbecCamera::getIRPixels(ofxOrbbec::IRStream stream){
+    auto & lease = mIRPixelsLease[stream];
+    lease = getIRFrame(stream);
+    return lease ? lease->data : mEmptyPixels;
+}
+
+const ofShortPixels & ofxOrbbecCamera::getIRPixelsRaw(ofxOrbbec::IRStream stream){
+    auto & lease = mIRRawLease[stream];
+    lease = getIRRawFrame(stream);
+    return lease ? lease->data : mEmptyShortPixels;
+}
+
+const vector <glm::vec3> & ofxOrbbecCamera::getPointCloud(){
+    mPointCloudLease = getPointCloudFrame();
+    return mPointCloudLease ? mPointCloudLease->data.points : mEmptyPointCloud.points;
+} 
+
+const ofMesh & ofxOrbbecCamera::getPointCloudMesh(){
+    mPointCloudMeshLease = getPointCloudFrame();
+    return mPointCloudMeshLease ? mPointCloudMeshLease->data.mesh : mEmptyPointCloud.mesh;
+}
+
+ofxOrbbec::FrameRef <ofPixels> ofxOrbbecCamera::getDepthFrame(){
     mExtDepthFrameNo = mInternalDepthFrameNo;
-    return mDepthPixels;
+    mDepthBuffer.update();
+    return mDepthBuffer.front();
 }
 
-ofFloatPixels ofxOrbbecCamera::getDepthPixelsF(){
+ofxOrbbec::FrameRef <ofShortPixels> ofxOrbbecCamera::getDepthRawFrame(){
     mExtDepthFrameNo = mInternalDepthFrameNo;
-    return mDepthPixelsF;
-} 
+    mDepthRawBuffer.update();
+    return mDepthRawBuffer.front();
+}
+
+ofxOrbbec::FrameRef <ofFloatPixels> ofxOrbbecCamera::getDepthFloatFrame(){
+    //asking for it is what turns it on for the next depthFloatPullFrames frames, the first call may come back empty
+    mDepthFloatPullFrames = std::max(mCurrentSettings.depthFloatPullFrames, 1);
+    mExtDepthFrameNo = mInternalDepthFrameNo;
+    mDepthFloatBuffer.update();
+    return mDepthFloatBuffer.front();
+}
 
-ofPixels ofxOrbbecCamera::getColorPixels(){
+ofxOrbbec::FrameRef <ofPixels> ofxOrbbecCamera::getColorFrame(){
+    markColorPulled();
     mExtColorFrameNo = mInternalColorFrameNo;
-    return mColorPixels;
+    mColorBuffer.update();
+    return mColorBuffer.front();
 }
 
-vector <glm::vec3> ofxOrbbecCamera::getPointCloud(){
+ofxOrbbec::FrameRef <ofxOrbbec::PointCloudData> ofxOrbbecCamera::getPointCloudFrame(){
     mExtDepthFrameNo = mInternalDepthFrameNo;
-    return mPointCloudPtsLocal;
-} 
+    mPointCloudBuffer.update();
+    return mPointCloudBuffer.front();
+}
 
-ofMesh ofxOrbbecCamera::getPointCloudMesh(){
+ofxOrbbec::FrameRef <ofPixels> ofxOrbbecCamera::getIRFrame(ofxOrbbec::IRStream stream){
+    mExtIRFrameNo = mInternalIRFrameNo;
+    auto & ir = mIR[stream];
+    ir.buffer.update();
+    return ir.buffer.front();
+}
+
+ofxOrbbec::FrameRef <ofShortPixels> ofxOrbbecCamera::getIRRawFrame(ofxOrbbec::IRStream stream){
+    mExtIRFrameNo = mInternalIRFrameNo;
+    auto & ir = mIR[stream];
+    ir.rawBuffer.update();
+    return ir.rawBuffer.front();
+}
+
+ofxOrbbec::FrameRef <ofPixels> ofxOrbbecCamera::getColorPyramidFrame(ofxOrbbec::PyramidLevel level){
+    markColorPulled();
+    mExtColorFrameNo = mInternalColorFrameNo;
+    auto & buffer = mColorPyramid.buffer[level];
+    buffer.update();
+    return buffer.front();
+}
+
+ofxOrbbec::FrameRef <ofxOrbbec::YUVPlanes> ofxOrbbecCamera::getColorPlanesFrame(){
+    markColorPulled();
+    mExtColorFrameNo = mInternalColorFrameNo;
+    mColorPlanesBuffer.update();
+    return mColorPlanesBuffer.front();
+}
+
+ofxOrbbec::FrameRef <ofShortPixels> ofxOrbbecCamera::getDepthPyramidFrame(ofxOrbbec::PyramidLevel level){
+    mExtDepthFrameNo = mInternalDepthFrameNo;
+    auto & buffer = mDepthPyramid.buffer[level];
+    buffer.update();
+    return buffer.front();
+}
+
+ofxOrbbec::FrameSetRef ofxOrbbecCamera::getFrameSet(){
+    markColorPulled();
     mExtDepthFrameNo = mInternalDepthFrameNo;
-    return mPointCloudMeshLocal;
+    mExtColorFrameNo = mInternalColorFrameNo;
+    mExtIRFrameNo = mInternalIRFrameNo;
+    mFrameSetBuffer.update();
+    return mFrameSetBuffer.front();
+}
+
+std::shared_ptr <ofxOrbbec::FrameSetSubscription> ofxOrbbecCamera::subscribe(const ofxOrbbec::SubscriptionSettings & settings){
+    auto subscription = std::make_shared<ofxOrbbec::FrameSetSubscription>(settings, mCurrentSettings.threadName + " delivery");
+    std::unique_lock<std::mutex> lck(mSubscriptionMutex);
+    mSubscriptions.push_back(subscription);
+    updateSubscriptionCounts();
+    return subscription;
+}
+
+void ofxOrbbecCamera::unsubscribe(std::shared_ptr <ofxOrbbec::FrameSetSubscription> subscription){
+    std::unique_lock<std::mutex> lck(mSubscriptionMutex);
+    for(size_t i = 0; i < mSubscriptions.size(); i++){
+        if( mSubscriptions[i].lock() == subscription ){
+            mSubscriptions.erase(mSubscriptions.begin() + i);
+            break;
+        }
+    }
+    updateSubscriptionCounts();
+}
+
+//called with mSubscriptionMutex held whenever the list changes, so the stages can check what's wanted without taking it
+void ofxOrbbecCamera::updateSubscriptionCounts(){
+    int numDepthFloat = 0, numColor = 0;
+    for(auto & weak : mSubscriptions){
+        auto subscription = weak.lock();
+        if( subscription ){
+            numDepthFloat += subscription->getSettings().bDepthFloat ? 1 : 0;
+            numColor += subscription->getSettings().bColor ? 1 : 0;
+        }
+    }
+    mNumDepthFloatSubscriptions = numDepthFloat;
+    mNumColorSubscriptions = numColor;
+}
+
+std::shared_ptr <ofxOrbbec::CompressedSubscription> ofxOrbbecCamera::subscribeCompressed(const ofxOrbbec::SubscriptionSettings & settings){
+    auto subscription = std::make_shared<ofxOrbbec::CompressedSubscription>(settings, mCurrentSettings.threadName + " delivery");
+    std::unique_lock<std::mutex> lck(mCompressedMutex);
+    mCompressedSubscriptions.push_back(subscription);
+    return subscription;
+}
+
+void ofxOrbbecCamera::unsubscribe(std::shared_ptr <ofxOrbbec::CompressedSubscription> subscription){
+    std::unique_lock<std::mutex> lck(mCompressedMutex);
+    for(size_t i = 0; i < mCompressedSubscriptions.size(); i++){
+        if( mCompressedSubscriptions[i].lock() == subscription ){
+            mCompressedSubscriptions.erase(mCompressedSubscriptions.begin() + i);
+            break;
+        }
+    }
+}
+
+bool ofxOrbbecCamera::waitForNewFrame(uint64_t timeoutMs){
+    return waitForFrameSet(timeoutMs) != nullptr;
+}
+
+ofxOrbbec::FrameSetRef ofxOrbbecCamera::waitForFrameSet(uint64_t timeoutMs){
+    markColorPulled();
+    std::unique_lock<std::mutex> lck(mFrameSetWaitMutex);
+    uint64_t seq = mFrameSetSeq;
+    if( mFrameSetCondition.wait_for(lck, std::chrono::milliseconds(timeoutMs), [&]{ return mFrameSetSeq != seq; }) ){
+        return mLatestFrameSet;
+    }
+    return ofxOrbbec::FrameSetRef();
 }
 
 void ofxOrbbecCamera::update(){
@@ -314,6 +798,8 @@ void ofxOrbbecCamera::update(){
         bNewFrameDepth = bNewFrameColor = bNewFrameIR = false; 
         if( mInternalDepthFrameNo > mExtDepthFrameNo ){
             bNewFrameDepth = true; 
+        }
+        if( mInternalIRFrameNo > mExtIRFrameNo ){
             bNewFrameIR = true; 
         }
         if( mInternalColorFrameNo > mExtColorFrameNo ){
@@ -332,350 +818,942 @@ void ofxOrbbecCamera::update(){
 }
 
 void ofxOrbbecCamera::threadedFunction(){
+    mCaptureThreadHandle.setup(mCurrentSettings.threadName + " capture", mCurrentSettings.captureThread);
+
     while(isThreadRunning()){
         if( mPipe ){
             auto frameSet = mPipe->waitForFrames(20);
             if(frameSet) {
-                
-                if( mCurrentSettings.bDepth ){
-                    auto depthFrame = frameSet->getFrame(OB_FRAME_DEPTH);
-                    if(depthFrame) {
-                        mDepthPixels = processFrame(depthFrame);
-
-                        if( mCurrentSettings.bPointCloud && !mCurrentSettings.bPointCloudRGB ){
-                            try {
-                                std::shared_ptr<ob::Frame> pointCloudFrame = pointCloud->process(frameSet);
-                                pointCloudToMesh(frameSet->depthFrame());
-                            }
-                            catch(std::exception &e) {
-                                std::cout << "Get point cloud failed" << std::endl;
-                            };
-                        }else{
-                            mInternalDepthFrameNo++; 
-                        }
+                processFrameSet(frameSet);
+            }
+        }else{
+            ofSleepMillis(2);
+        }
+    }
+}
 
-                    }
-                }
+void ofxOrbbecCamera::processFrameSet(shared_ptr<ob::FrameSet> frameSet){
+    if( lock() ){
+        mCaptureStats.numFrameSets++;
+        unlock();
+    }
 
-                if( mCurrentSettings.bColor ){
-                    auto colorFrame = frameSet->getFrame(OB_FRAME_COLOR);
-                    if(colorFrame) {
-                        mColorPixels = processFrame(colorFrame);
-
-                        if( mCurrentSettings.bPointCloudRGB ){
-                            if(frameSet != nullptr && frameSet->depthFrame() != nullptr && frameSet->colorFrame() != nullptr) {
-                                // point position value multiply depth value scale to convert uint to millimeter (for some devices, the default depth value uint is not
-                                // millimeter)
-                                auto depthValueScale = frameSet->depthFrame()->getValueScale();
-                                pointCloud->setPositionDataScaled(depthValueScale);
-                                try {
-                                    std::shared_ptr<ob::Frame> pointCloudFrame = pointCloud->process(frameSet);
-                                    pointCloudToMesh(frameSet->depthFrame(), frameSet->colorFrame());
-                                }
-                                catch(std::exception &e) {
-                                    std::cout << "Get point cloud failed" << std::endl;
-                                }
-                            }
-                        }else{
-                            //In case h264 and we can't decode - pixels will be empty 
-                            if(mColorPixels.getWidth()){
-                                mInternalColorFrameNo++; 
-                            }
-                        }
-
-                
+    //before anything is decoded so recorders never wait on it
+    if( mCurrentSettings.bColor ){
+        publishCompressed(frameSet);
+    }
 
-                    }
+    ofxOrbbec::StreamJob job;
+    job.frameSet = frameSet;
+    job.frameSetData = mFrameSetPool.acquire();
+    setFrameInfo(*job.frameSetData, frameSet);
+
+    auto & products = job.frameSetData->data;
+    products.depth.reset();
+    products.depthRaw.reset();
+    products.depthFloat.reset();
+    products.color.reset();
+    products.colorPlanes.reset();
+    products.pointCloud.reset();
+    for(int i = 0; i < ofxOrbbec::IR_NUM_STREAMS; i++){
+        products.ir[i].reset();
+        products.irRaw[i].reset();
+    }
+    for(int i = 0; i < ofxOrbbec::PYRAMID_NUM_LEVELS; i++){
+        products.colorPyramid[i].reset();
+        products.depthPyramid[i].reset();
+    }
+    products.numPendingStages = (hasDepthStage() ? 1 : 0) + (mCurrentSettings.bColor ? 1 : 0);
+
+    //color goes to the MJPG decode pool first so it can start while depth is processed
+    if( mCurrentSettings.bColor && mColorDecodePool.isRunning() ){
+        mColorDecodePool.push(job);
+    }
+
+    if( mCurrentSettings.bThreadedStreams ){
+        //each stream runs at its own rate on its own worker
+        if( hasDepthStage() ){
+            mDepthWorker.push(job);
+        }
+        if( mCurrentSettings.bColor && !mColorDecodePool.isRunning() ){
+            mColorWorker.push(job);
+        }
+    }else{
+        if( hasDepthStage() ){
+            processDepthFrameSet(job);
+        }
+        if( mCurrentSettings.bColor && !mColorDecodePool.isRunning() ){
+            processColorFrameSet(job);
+        }
+    }
+}
+
+//the last stage to finish with a frameset publishes all of its products at once
+void ofxOrbbecCamera::finishStage(ofxOrbbec::StreamJob & job){
+    if( --job.frameSetData->data.numPendingStages == 0 ){
+        ofxOrbbec::FrameSetRef frameSet = job.frameSetData;
+
+        //one frameset is published at a time so the buffer, latest frameset and subscriber queues all see the same sequence.
+        //That's serialised, not sorted - with bThreadedStreams the depth and color workers can finish a later frameset first.
+        //Nothing below waits on a consumer, bBlockWhenFull subscriptions wait on their own delivery thread
+        std::unique_lock<std::mutex> publishLock(mFrameSetPublishMutex);
+
+        mFrameSetBuffer.back() = frameSet;
+        mFrameSetBuffer.publish();
+
+        {
+            std::unique_lock<std::mutex> lck(mFrameSetWaitMutex);
+            mLatestFrameSet = frameSet;
+            mFrameSetSeq++;
+        }
+        mFrameSetCondition.notify_all();
+
+        //copied out so subscribe() / unsubscribe() and the other stages never wait on the pushes
+        {
+            std::unique_lock<std::mutex> lck(mSubscriptionMutex);
+            size_t numLive = mSubscriptions.size();
+            for(size_t i = 0; i < mSubscriptions.size(); ){
+                auto subscription = mSubscriptions[i].lock();
+                if( subscription ){
+                    mSubscriptionSnapshot.push_back(subscription);
+                    i++;
+                }else{
+                    mSubscriptions.erase(mSubscriptions.begin() + i);
                 }
+            }
+            if( mSubscriptions.size() != numLive ){
+                updateSubscriptionCounts();
+            }
+        }
+        for(auto & subscription : mSubscriptionSnapshot){
+            subscription->push(frameSet);
+        }
+        mSubscriptionSnapshot.clear();
+
+        //notifying copies the listener list so skip it when nobody is listening
+        if( newFrameSetEvent.size() ){
+            ofNotifyEvent(newFrameSetEvent, frameSet);
+        }
+    }
+}
+
+//depth + point cloud + IR stage
+void ofxOrbbecCamera::processDepthFrameSet(ofxOrbbec::StreamJob & job){
+    auto & frameSet = job.frameSet;
+    auto & products = job.frameSetData->data;
+
+    auto depthFrame = mCurrentSettings.bDepth ? frameSet->getFrame(OB_FRAME_DEPTH) : shared_ptr<ob::Frame>();
+    if(depthFrame) {
+        if( mCurrentSettings.bDepthPreview ){
+            auto depthOut = mDepthPool.acquire();
+            if( processFrame(depthFrame, depthOut->data) ){
+                setFrameInfo(*depthOut, depthFrame);
+                mDepthBuffer.back() = depthOut;
+                mDepthBuffer.publish();
+                products.depth = depthOut;
+            }
+        }
+
+        bool bFloat = isDepthFloatWanted();
+        if( mCurrentSettings.bDepthRaw || bFloat || mCurrentSettings.depthPyramidLevels > 0 ){
+            processDepthRaw(depthFrame->as<ob::DepthFrame>(), bFloat, products);
+        }
 
+        if( mCurrentSettings.bPointCloud && !mCurrentSettings.bPointCloudRGB ){
+            products.pointCloud = pointCloudToMesh(frameSet->depthFrame());
+        }else{
+            mInternalDepthFrameNo++; 
+        }
+
+        updateStreamStats(mCaptureStats.depth, depthFrame);
+    }
+
+    bool bNewIR = false;
+    for(int i = 0; i < ofxOrbbec::IR_NUM_STREAMS; i++){
+        auto stream = (ofxOrbbec::IRStream)i;
+        if( !isIREnabled(stream) ){
+            continue;
+        }
+        auto irFrame = frameSet->getFrame(getIRFrameType(stream));
+        if( irFrame ){
+            processIRFrame(stream, irFrame->as<ob::VideoFrame>(), products);
+            updateStreamStats(mCaptureStats.ir[i], irFrame);
+            bNewIR = true;
+        }
+    }
+    if( bNewIR ){
+        mInternalIRFrameNo++;
+    }
+
+    finishStage(job);
+}
+
+//16-bit copy and / or 8-bit auto gain of one IR frame
+void ofxOrbbecCamera::processIRFrame(ofxOrbbec::IRStream stream, shared_ptr<ob::VideoFrame> irFrame, ofxOrbbec::FrameSetData & products){
+    auto & ir = mIR[stream];
+    size_t w = irFrame->width();
+    size_t h = irFrame->height();
+    OBFormat format = irFrame->format();
+    auto region = ofxOrbbec::mapRegion(mCurrentSettings.irRegion, w, h);
+
+    if( mCurrentSettings.bIRRaw && format == OB_FORMAT_Y16 ){
+        auto rawOut = ir.rawPool.acquire();
+        rawOut->data.allocate(region.outWidth, region.outHeight, 1);
+        ofxOrbbec::copyRegion((const uint16_t *)irFrame->data(), w, region, rawOut->data.getData());
+        setFrameInfo(*rawOut, irFrame);
+        ir.rawBuffer.back() = rawOut;
+        ir.rawBuffer.publish();
+        products.irRaw[stream] = rawOut;
+    }
+
+    if( mCurrentSettings.bIRPreview ){
+        auto out = ir.pool.acquire();
+        bool bOk = false;
+        if( format == OB_FORMAT_Y16 ){
+            out->data.allocate(region.outWidth, region.outHeight, 1);
+            ofxOrbbec::irToPreview((const uint16_t *)irFrame->data(), w, region, ir.autoGain, out->data.getData());
+            bOk = true;
+        }else if( format == OB_FORMAT_Y8 ){
+            out->data.allocate(region.outWidth, region.outHeight, 1);
+            ofxOrbbec::copyRegion((const uint8_t *)irFrame->data(), w, region, out->data.getData());
+            bOk = true;
+        }else if( format == OB_FORMAT_MJPG ){
+            bOk = ir.jpegDecoder.decode((const uint8_t *)irFrame->data(), irFrame->dataSize(), 1, OF_PIXELS_GRAY, out->data);
+        }
+
+        if( bOk ){
+            setFrameInfo(*out, irFrame);
+            ir.buffer.back() = out;
+            ir.buffer.publish();
+            products.ir[stream] = out;
+        }
+    }
+}
+
+bool ofxOrbbecCamera::isIREnabled(ofxOrbbec::IRStream stream) const{
+    if( stream == ofxOrbbec::IR_LEFT ){
+        return mCurrentSettings.bIRLeft;
+    }
+    if( stream == ofxOrbbec::IR_RIGHT ){
+        return mCurrentSettings.bIRRight;
+    }
+    return mCurrentSettings.bIR;
+}
+
+bool ofxOrbbecCamera::hasDepthStage() const{
+    return mCurrentSettings.bDepth || mCurrentSettings.bIR || mCurrentSettings.bIRLeft || mCurrentSettings.bIRRight;
+}
+
+//color decode + RGB point cloud stage
+void ofxOrbbecCamera::processColorFrameSet(ofxOrbbec::StreamJob & job){
+    //H.264 / H.265 is finished by the decode thread once the frame's picture is out
+    if( queueH26XPacket(job) ){
+        return;
+    }
+    decodeColor(job, mJpegDecoder);
+    publishColor(job);
+}
+
+//the part of the color stage that can run on several frames at once
+void ofxOrbbecCamera::decodeColor(ofxOrbbec::StreamJob & job, ofxOrbbec::JpegDecoder & jpegDecoder){
+    job.color.reset();
+    job.colorPlanes.reset();
+
+    auto colorFrame = job.frameSet->getFrame(OB_FRAME_COLOR);
+    if( !colorFrame ){
+        return;
+    }
+
+    //H.264 / H.265 only gets here when nothing wants it decoded - see queueH26XPacket()
+    OBFormat format = colorFrame->format();
+    if( format == OB_FORMAT_H264 || format == OB_FORMAT_H265 ){
+        return;
+    }
+    if( format == OB_FORMAT_MJPG && mCurrentSettings.bDecodeColorOnDemand && !isColorDecodeWanted() ){
+        return;
+    }
+
+    auto colorOut = mColorPool.acquire();
+
+    //a buffer that wrapped an SDK frame last time has to let go of it before it can own pixels again
+    if( colorOut->source ){
+        colorOut->data.clear();
+        colorOut->source.reset();
+    }
+
+    //pyramid levels are filled by the conversion when it can do them in the same pass
+    ofxOrbbec::FrameData<ofPixels> * pyramidOut[ofxOrbbec::PYRAMID_NUM_LEVELS] = {nullptr, nullptr};
+    ofPixels * pyramid[ofxOrbbec::PYRAMID_NUM_LEVELS] = {nullptr, nullptr};
+    for(int i = 0; i < mCurrentSettings.colorPyramidLevels; i++){
+        job.colorPyramid[i] = mColorPyramid.pool[i].acquire();
+        pyramidOut[i] = job.colorPyramid[i].get();
+        pyramid[i] = &pyramidOut[i]->data;
+    }
+
+    bool bColorOk = false;
+    auto videoFrame = colorFrame->as<ob::VideoFrame>();
+    bool bFullFrame = ofxOrbbec::mapRegion(mCurrentSettings.colorRegion, videoFrame->width(), videoFrame->height(), getColorAlignX(format)).isFull(videoFrame->width(), videoFrame->height());
+    if( mCurrentSettings.bColorZeroCopy && bFullFrame && colorFrame->format() == OB_FORMAT_RGB && mCurrentSettings.colorPixelFormat == OF_PIXELS_RGB ){
+        colorOut->data.setFromExternalPixels((unsigned char *)videoFrame->data(), videoFrame->width(), videoFrame->height(), OF_PIXELS_RGB);
+        colorOut->source = colorFrame;
+        bColorOk = true;
+    }else if( colorFrame->format() == OB_FORMAT_MJPG ){
+        bColorOk = jpegDecoder.decode((const uint8_t *)colorFrame->data(), colorFrame->dataSize(), mCurrentSettings.mjpgDecodeScale, mCurrentSettings.colorPixelFormat, colorOut->data);
+    }else{
+        bColorOk = processFrame(colorFrame, colorOut->data, pyramid);
+    }
+
+    bool bYUV = format == OB_FORMAT_NV21 || format == OB_FORMAT_YUYV || format == OB_FORMAT_YUY2 || format == OB_FORMAT_UYVY;
+    if( bColorOk && pyramid[0] && !bYUV ){
+        buildColorPyramid(colorOut->data, pyramid);
+    }
+
+    if( bColorOk ){
+        setFrameInfo(*colorOut, colorFrame);
+        job.color = colorOut;
+        for(auto level : pyramidOut){
+            if( level ){
+                setFrameInfo(*level, colorFrame);
             }
         }
+    }else{
+        for(auto & level : job.colorPyramid){
+            level.reset();
+        }
+    }
+}
+
+//hands an H.264 / H.265 frameset to the decode thread - false when the color stage should carry on without a picture
+bool ofxOrbbecCamera::queueH26XPacket(ofxOrbbec::StreamJob & job){
+    auto colorFrame = job.frameSet->getFrame(OB_FRAME_COLOR);
+    if( !colorFrame ){
+        return false;
+    }
+
+    OBFormat format = colorFrame->format();
+    if( format != OB_FORMAT_H264 && format != OB_FORMAT_H265 ){
+        return false;
+    }
+    if( mCurrentSettings.bDecodeColorOnDemand && !isColorDecodeWanted() ){
+        //the gap makes the decoder wait for a keyframe once decoding starts again
+        mH26XSeq++;
+        return false;
+    }
+
+    //always called in frameset order
+    ofxOrbbec::H26XJob h26xJob;
+    auto & packet = h26xJob.packet;
+    packet.data = (const uint8_t *)colorFrame->data();
+    packet.size = colorFrame->dataSize();
+    packet.bH264 = format == OB_FORMAT_H264;
+    packet.seq = ++mH26XSeq;
+    packet.index = colorFrame->index();
+    packet.timeStampUs = colorFrame->timeStampUs();
+    packet.systemTimeStampUs = colorFrame->systemTimeStampUs();
+    packet.pushTimeUs = ofGetElapsedTimeMicros();
+    packet.owner = colorFrame;
+    h26xJob.job = job;
+    mH26XWorker.push(h26xJob);
+    return true;
+}
+
+//runs on the H.26x thread, once per packet - each picture that comes out goes to the frameset it was decoded from.
+//With B-frames pictures come out in display order, so framesets are only finished once everything before them is
+void ofxOrbbecCamera::decodeH26XPacket(ofxOrbbec::H26XJob & h26xJob){
+    size_t numPending = mH26XPending.size();
+    uint64_t seq = h26xJob.packet.seq;
+
+    if( seq != mH26XLastSeq + 1 ){
+        //the decoder flushes on a gap so nothing still waiting will get its picture
+        finishH26XJobs(mH26XLastSeq);
+        mH26XFinishSeq = seq;
+    }else if( seq >= numPending ){
+        //still waiting after a full lap means the decoder dropped that picture
+        finishH26XJobs(seq - numPending);
+    }
+    mH26XLastSeq = seq;
+
+    auto & slot = mH26XPending[seq % numPending];
+    slot = h26xJob;
+    slot.bDone = false;
+
+    bool bSent = mH26XDecoder.decode(slot.packet, [this, numPending](const ofxOrbbec::H26XPicture & picture){
+        auto & pending = mH26XPending[picture.seq % numPending];
+        if( !pending.job.frameSetData || pending.packet.seq != picture.seq || pending.bDone ){
+            return;
+        }
+        decodeH26XPicture(picture, pending.job);
+        pending.bDone = true;
+    });
+
+    //skipped waiting for a keyframe or refused - no picture is coming for this one
+    if( !bSent ){
+        slot.bDone = true;
+    }
 
-        ofSleepMillis(2);
+    //everything ready in frame order, up to the first one still waiting on its picture
+    while( mH26XFinishSeq <= mH26XLastSeq ){
+        auto & pending = mH26XPending[mH26XFinishSeq % numPending];
+        if( pending.job.frameSetData && pending.packet.seq == mH26XFinishSeq ){
+            if( !pending.bDone ){
+                break;
+            }
+            finishH26XJob(pending);
+        }
+        mH26XFinishSeq++;
     }
 }
-        
-bool ofxOrbbecCamera::isFrameNew(){
-    return bNewFrameColor || bNewFrameDepth || bNewFrameIR;
+
+//finishes every frameset up to and including seq, oldest first, whether or not its picture came
+void ofxOrbbecCamera::finishH26XJobs(uint64_t seq){
+    size_t numPending = mH26XPending.size();
+    for(; mH26XFinishSeq <= seq; mH26XFinishSeq++){
+        auto & pending = mH26XPending[mH26XFinishSeq % numPending];
+        if( pending.packet.seq == mH26XFinishSeq ){
+            finishH26XJob(pending);
+        }
+    }
 }
 
-bool ofxOrbbecCamera::isFrameNewDepth(){
-    return bNewFrameDepth;
+//fills the job's color outputs from one decoded picture
+void ofxOrbbecCamera::decodeH26XPicture(const ofxOrbbec::H26XPicture & picture, ofxOrbbec::StreamJob & job){
+    ofxOrbbec::H26XOutput output = mCurrentSettings.h26x.output;
+
+    if( output != ofxOrbbec::H26X_OUTPUT_PIXELS ){
+        auto planesOut = mColorPlanesPool.acquire();
+        if( mH26XDecoder.getPlanes(picture, planesOut->data, planesOut->source) ){
+            job.colorPlanes = planesOut;
+        }
+    }
+
+    if( output != ofxOrbbec::H26X_OUTPUT_PLANES ){
+        auto colorOut = mColorPool.acquire();
+        if( mH26XDecoder.convert(picture, mCurrentSettings.colorPixelFormat, colorOut->data) ){
+            job.color = colorOut;
+
+            ofPixels * pyramid[ofxOrbbec::PYRAMID_NUM_LEVELS] = {nullptr, nullptr};
+            for(int i = 0; i < mCurrentSettings.colorPyramidLevels; i++){
+                job.colorPyramid[i] = mColorPyramid.pool[i].acquire();
+                pyramid[i] = &job.colorPyramid[i]->data;
+            }
+            if( pyramid[0] ){
+                buildColorPyramid(colorOut->data, pyramid);
+            }
+        }
+    }
+
+    auto setPictureInfo = [&](auto & dst){
+        dst.index = picture.index;
+        dst.timeStampUs = picture.timeStampUs;
+        dst.systemTimeStampUs = picture.systemTimeStampUs;
+        dst.decodeLatencyUs = picture.latencyUs;
+    };
+    if( job.color ){
+        setPictureInfo(*job.color);
+    }
+    if( job.colorPlanes ){
+        setPictureInfo(*job.colorPlanes);
+    }
+    for(auto & level : job.colorPyramid){
+        if( level ){
+            setPictureInfo(*level);
+        }
+    }
 }
 
-bool ofxOrbbecCamera::isFrameNewColor(){
-    return bNewFrameColor;
+//publishes whatever the job has - nothing when its picture never came - and frees the slot
+void ofxOrbbecCamera::finishH26XJob(ofxOrbbec::H26XJob & pending){
+    if( pending.job.frameSetData ){
+        publishColor(pending.job);
+    }
+    pending = ofxOrbbec::H26XJob();
 }
 
+void ofxOrbbecCamera::publishColor(ofxOrbbec::StreamJob & job){
+    auto & frameSet = job.frameSet;
+    auto & products = job.frameSetData->data;
 
-#ifdef OFXORBBEC_DECODE_H264_H265
+    auto colorFrame = frameSet->getFrame(OB_FRAME_COLOR);
+    if(colorFrame) {
+        if( job.color ){
+            mColorBuffer.back() = job.color;
+            mColorBuffer.publish();
+            products.color = job.color;
+        }
+        for(int i = 0; i < ofxOrbbec::PYRAMID_NUM_LEVELS; i++){
+            if( job.colorPyramid[i] ){
+                mColorPyramid.buffer[i].back() = job.colorPyramid[i];
+                mColorPyramid.buffer[i].publish();
+                products.colorPyramid[i] = job.colorPyramid[i];
+            }
+        }
+        if( job.colorPlanes ){
+            mColorPlanesBuffer.back() = job.colorPlanes;
+            mColorPlanesBuffer.publish();
+            products.colorPlanes = job.colorPlanes;
+        }
 
-void ofxOrbbecCamera::initH26XCodecs(){
-    if( !bInitOneTime ){
-        // Initialize FFmpeg libraries
-        av_register_all();
-        avcodec_register_all();
-        bInitOneTime = true; 
+        if( mCurrentSettings.bPointCloudRGB ){
+            if(frameSet != nullptr && frameSet->depthFrame() != nullptr && job.color) {
+                products.pointCloud = pointCloudToMesh(frameSet->depthFrame(), &job.color->data);
+            }
+        }else{
+            if( job.color || job.colorPlanes ){
+                mInternalColorFrameNo++; 
+            }
+        }
 
-        // Allocate an AVCodecContext and set its codec
-        codec264 = avcodec_find_decoder(AV_CODEC_ID_H264);
-        codecContext264 = avcodec_alloc_context3(codec264);
-        avcodec_open2(codecContext264, codec264, NULL);
+        updateStreamStats(mCaptureStats.color, colorFrame);
+    }
 
-        // // Allocate an AVCodecContext and set its codec
-        codec265 = avcodec_find_decoder(AV_CODEC_ID_H265);
-        codecContext265 = avcodec_alloc_context3(codec265);
-        avcodec_open2(codecContext265, codec265, NULL);
+    job.color.reset();
+    job.colorPlanes.reset();
+    for(auto & level : job.colorPyramid){
+        level.reset();
     }
+    finishStage(job);
 }
 
-ofPixels ofxOrbbecCamera::decodeH26XFrame(uint8_t * myData, int dataSize, bool bH264){
-    initH26XCodecs();
-    
-    AVPacket packet; 
-    av_init_packet(&packet);
-    packet.data = myData;
-    packet.size = dataSize;
+//full precision depth outputs - mm, metres and the mm pyramid from one pass over the Y16 data
+//called once per depth frame
+bool ofxOrbbecCamera::isDepthFloatWanted(){
+    if( mCurrentSettings.bDepthFloat || mNumDepthFloatSubscriptions > 0 ){
+        return true;
+    }
+    return takePullFrame(mDepthFloatPullFrames);
+}
 
-    // Allocate an AVFrame for decoded data
-    AVFrame* frame = av_frame_alloc();
-    
-    ofPixels pix;
+//called once per compressed color frame
+bool ofxOrbbecCamera::isColorDecodeWanted(){
+    if( mCurrentSettings.bPointCloudRGB || mNumColorSubscriptions > 0 || newFrameSetEvent.size() ){
+        return true;
+    }
+    return takePullFrame(mColorPullFrames);
+}
+
+//asking for color is what turns decoding on, the first call may come back empty
+void ofxOrbbecCamera::markColorPulled(){
+    mColorPullFrames = std::max(mCurrentSettings.colorPullFrames, 1);
+}
 
-    auto codecContext = codecContext264;
-    if( !bH264 ){
-        codecContext = codecContext265; 
+//hands the compressed payload to the passthrough subscribers - no copy, each frame references the SDK frame
+void ofxOrbbecCamera::publishCompressed(shared_ptr<ob::FrameSet> frameSet){
+    //only the capture thread gets here so the snapshot needs no lock of its own
+    {
+        std::unique_lock<std::mutex> lck(mCompressedMutex);
+        for(size_t i = 0; i < mCompressedSubscriptions.size(); ){
+            auto subscription = mCompressedSubscriptions[i].lock();
+            if( subscription ){
+                mCompressedSnapshot.push_back(subscription);
+                i++;
+            }else{
+                mCompressedSubscriptions.erase(mCompressedSubscriptions.begin() + i);
+            }
+        }
+    }
+    if( mCompressedSnapshot.empty() ){
+        return;
     }
 
-    int ret = avcodec_send_packet(codecContext, &packet);
-    if (ret < 0) {
-        cout << "Error sending a packet for decoding" << endl; 
-        return pix; 
+    auto colorFrame = frameSet->getFrame(OB_FRAME_COLOR);
+    OBFormat format = colorFrame ? colorFrame->format() : OB_FORMAT_UNKNOWN;
+    if( format != OB_FORMAT_H264 && format != OB_FORMAT_H265 && format != OB_FORMAT_MJPG ){
+        mCompressedSnapshot.clear();
+        return;
     }
- 
-    int frameDecoded = avcodec_receive_frame(codecContext, frame);
 
-    if( frameDecoded == 0 ){
+    auto videoFrame = colorFrame->as<ob::VideoFrame>();
+    auto out = mCompressedPool.acquire();
+    auto & compressed = out->data;
+    compressed.format = format;
+    compressed.data = (const uint8_t *)videoFrame->data();
+    compressed.size = videoFrame->dataSize();
+    compressed.width = videoFrame->width();
+    compressed.height = videoFrame->height();
+    compressed.bKeyFrame = format == OB_FORMAT_MJPG || ofxOrbbec::H26XDecoder::isKeyFrame(compressed.data, compressed.size, format == OB_FORMAT_H264);
+    out->source = colorFrame;
+    setFrameInfo(*out, colorFrame);
+
+    ofxOrbbec::CompressedFrameRef frame = out;
+    for(auto & subscription : mCompressedSnapshot){
+        subscription->push(frame);
+    }
+    mCompressedSnapshot.clear();
+}
 
-        // Allocate an AVFrame for RGB data
-        AVFrame* rgbFrame = av_frame_alloc();
+void ofxOrbbecCamera::processDepthRaw(shared_ptr<ob::DepthFrame> depthFrame, bool bFloat, ofxOrbbec::FrameSetData & products){
+    if( depthFrame->format() != OB_FORMAT_Y16 ){
+        return;
+    }
 
-        rgbFrame->format = AV_PIX_FMT_RGB24; 
-        rgbFrame->width = codecContext->width; 
-        rgbFrame->height = codecContext->height; 
+    size_t w = depthFrame->width();
+    auto region = ofxOrbbec::mapRegion(mCurrentSettings.depthRegion, w, depthFrame->height());
 
-        av_frame_get_buffer(rgbFrame, 0);
+    shared_ptr<ofxOrbbec::FrameData<ofShortPixels>> rawOut;
+    shared_ptr<ofxOrbbec::FrameData<ofFloatPixels>> floatOut;
+    uint16_t * dstMM = nullptr;
+    float * dstMetres = nullptr;
 
-        // Create a sws context for RGB conversion
-        swsContext = sws_getCachedContext(swsContext, codecContext->width, codecContext->height, codecContext->pix_fmt,
-            codecContext->width, codecContext->height, (AVPixelFormat)rgbFrame->format, SWS_BILINEAR, NULL, NULL, NULL);
-        
-        // Convert the decoded frame to RGB
-        int result = sws_scale(swsContext, frame->data, frame->linesize, 0, frame->height, rgbFrame->data, rgbFrame->linesize);
-        pix.setFromPixels((unsigned char * )rgbFrame->data[0], codecContext->width, codecContext->height, 3); 
+    if( mCurrentSettings.bDepthRaw ){
+        rawOut = mDepthRawPool.acquire();
+        rawOut->data.allocate(region.outWidth, region.outHeight, 1);
+        dstMM = rawOut->data.getData();
+    }
+    if( bFloat ){
+        floatOut = mDepthFloatPool.acquire();
+        floatOut->data.allocate(region.outWidth, region.outHeight, 1);
+        dstMetres = floatOut->data.getData();
+    }
+
+    const uint16_t * src = (const uint16_t *)depthFrame->data();
+    float valueScale = depthFrame->getValueScale();
+    int numLevels = mCurrentSettings.depthPyramidLevels;
+
+    if( numLevels == 0 ){
+        ofxOrbbec::convertDepthY16(src, w, region, valueScale, dstMM, dstMetres);
+    }else{
+        shared_ptr<ofxOrbbec::FrameData<ofShortPixels>> levels[ofxOrbbec::PYRAMID_NUM_LEVELS];
+        uint16_t * dstLevels[ofxOrbbec::PYRAMID_NUM_LEVELS] = {nullptr, nullptr};
+        for(int i = 0; i < numLevels; i++){
+            levels[i] = mDepthPyramid.pool[i].acquire();
+            levels[i]->data.allocate(region.outWidth >> (i + 1), region.outHeight >> (i + 1), 1);
+            dstLevels[i] = levels[i]->data.getData();
+        }
+
+        //4 rows at a time so they get reduced while they're still in cache
+        size_t outW = region.outWidth;
+        size_t halfW = outW / 2;
+        mDepthStrip.resize(dstMM ? 0 : outW * 4);
+        for(size_t row = 0; row < region.outHeight; row += 4){
+            ofxOrbbec::RegionMap strip = region;
+            strip.y = region.y + row * region.step;
+            strip.outHeight = std::min((size_t)4, region.outHeight - row);
+
+            uint16_t * mm = dstMM ? dstMM + row * outW : mDepthStrip.data();
+            ofxOrbbec::convertDepthY16(src, w, strip, valueScale, mm, dstMetres ? dstMetres + row * outW : nullptr);
+            ofxOrbbec::pyramidStrip(mm, outW, strip.outHeight, mCurrentSettings.depthPyramidReduce, dstLevels[0] + (row / 2) * halfW,
+                dstLevels[1] ? dstLevels[1] + (row / 4) * (halfW / 2) : nullptr);
+        }
+
+        for(int i = 0; i < numLevels; i++){
+            setFrameInfo(*levels[i], depthFrame);
+            mDepthPyramid.buffer[i].back() = levels[i];
+            mDepthPyramid.buffer[i].publish();
+            products.depthPyramid[i] = levels[i];
+        }
+    }
+
+    if( rawOut ){
+        setFrameInfo(*rawOut, depthFrame);
+        mDepthRawBuffer.back() = rawOut;
+        mDepthRawBuffer.publish();
+        products.depthRaw = rawOut;
+    }
+    if( floatOut ){
+        setFrameInfo(*floatOut, depthFrame);
+        mDepthFloatBuffer.back() = floatOut;
+        mDepthFloatBuffer.publish();
+        products.depthFloat = floatOut;
+    }
+}
+
+void ofxOrbbecCamera::updateStreamStats(ofxOrbbec::StreamStats & stats, shared_ptr<ob::Frame> frame){
+    //time from the SDK receiving the frame on the host to us finishing with it
+    uint64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    uint64_t frameUs = frame->systemTimeStampUs();
+    float latencyMs = nowUs > frameUs ? (nowUs - frameUs) / 1000.0f : 0.0f;
+
+    if( lock() ){
+        stats.numFrames++;
+        stats.lastLatencyMs = latencyMs;
+        stats.maxLatencyMs = std::max(stats.maxLatencyMs, latencyMs);
+        stats.avgLatencyMs = stats.numFrames == 1 ? latencyMs : ofLerp(stats.avgLatencyMs, latencyMs, 0.05f);
+        unlock();
+    }
+}
+
+ofxOrbbec::CaptureStats ofxOrbbecCamera::getCaptureStats(){
+    ofxOrbbec::CaptureStats stats;
+    if( lock() ){
+        stats = mCaptureStats;
+        unlock();
+    }
+    stats.depth.numDropped = mDepthWorker.getNumDropped();
+    stats.color.numDropped = mColorWorker.getNumDropped() + mColorDecodePool.getNumDropped() + mH26XWorker.getNumDropped();
+    return stats;
+}
 
-        av_frame_free(&rgbFrame);
+std::vector <ofxOrbbec::ThreadStats> ofxOrbbecCamera::getThreadStats(){
+    std::vector <ofxOrbbec::ThreadStats> stats;
+    if( mCaptureThreadHandle.isSetup() ){
+        stats.push_back(mCaptureThreadHandle.getStats());
     }
+    if( mDepthWorker.isThreadRunning() ){
+        stats.push_back(mDepthWorker.getThreadStats());
+    }
+    if( mColorWorker.isThreadRunning() ){
+        stats.push_back(mColorWorker.getThreadStats());
+    }
+    if( mH26XWorker.isThreadRunning() ){
+        stats.push_back(mH26XWorker.getThreadStats());
+    }
+    for(auto & worker : mColorDecodePool.getWorkerStats()){
+        stats.push_back(worker.thread);
+    }
+    return stats;
+}
+
+const ofxOrbbec::ProfileChoice & ofxOrbbecCamera::getDepthProfile() const{
+    return mDepthProfileChoice;
+}
+
+const ofxOrbbec::ProfileChoice & ofxOrbbecCamera::getColorProfile() const{
+    return mColorProfileChoice;
+}
+
+const ofxOrbbec::ProfileChoice & ofxOrbbecCamera::getIRProfile(ofxOrbbec::IRStream stream) const{
+    return mIR[stream].profile;
+}
+
+std::vector <ofxOrbbec::DecodeWorkerStats> ofxOrbbecCamera::getDecodeStats(){
+    return mColorDecodePool.getWorkerStats();
+}
+
+ofxOrbbec::H26XStats ofxOrbbecCamera::getH26XStats(){
+    return mH26XDecoder.getStats();
+}
+
+bool ofxOrbbecCamera::isFrameNew(){
+    return bNewFrameColor || bNewFrameDepth || bNewFrameIR;
+}
 
-    // Clean up and free allocated memory
-    av_frame_free(&frame);
+bool ofxOrbbecCamera::isFrameNewDepth(){
+    return bNewFrameDepth;
+}
+
+bool ofxOrbbecCamera::isFrameNewColor(){
+    return bNewFrameColor;
+}
 
-    return pix; 
+bool ofxOrbbecCamera::isFrameNewIR(){
+    return bNewFrameIR;
 }
 
-#endif 
 
 
-ofPixels ofxOrbbecCamera::processFrame(shared_ptr<ob::Frame> frame){
 
-    ofPixels pix; 
-    cv::Mat imuMat;
-    cv::Mat rstMat;
+//color and depth preview - IR has its own path in processIRFrame
+bool ofxOrbbecCamera::processFrame(shared_ptr<ob::Frame> frame, ofPixels & pix, ofPixels ** pyramid){
 
     try{
         
         if( !frame ){
-            return pix; 
+            return false; 
         }
 
         if(frame->type() == OB_FRAME_COLOR) {
             auto videoFrame = frame->as<ob::VideoFrame>();
             switch(videoFrame->format()) {
-            case OB_FORMAT_H264:
-
-                #ifdef OFXORBBEC_DECODE_H264_H265 
-                    pix = decodeH26XFrame((uint8_t*)videoFrame->data(), videoFrame->dataSize(), true);
-                #else
-                    ofLogError("ofxOrbbecCamera::processFrame") << " h264 / h265 not enabled. Define OFXORBBEC_DECODE_H264_H265 or set color format to OB_FORMAT_RGB " << endl;
-                #endif  
-
-            break; 
-            case OB_FORMAT_H265:
-
-                #ifdef OFXORBBEC_DECODE_H264_H265 
-                    pix = decodeH26XFrame((uint8_t*)videoFrame->data(), videoFrame->dataSize(), false);
-                #else
-                    ofLogError("ofxOrbbecCamera::processFrame") << " h264 / h265 not enabled. Define OFXORBBEC_DECODE_H264_H265 or set color format to OB_FORMAT_RGB " << endl;
-                #endif 
-
-            break; 
-            case OB_FORMAT_MJPG: {
-
-#if !defined(TARGET_OSX) && !defined(TARGET_WIN32)
-                cv::Mat rawMat(1, videoFrame->dataSize(), CV_8UC1, videoFrame->data());
-                rstMat = cv::imdecode(rawMat, 1);
-                cv::cvtColor(rstMat, rstMat, cv::COLOR_BGR2RGB);
-#else
-                ofLogError("ofxOrbbecCamera::processFrame") << " MJPG not supported - set color format to OB_FORMAT_RGB " << endl;
-#endif
-
-            } break;
-            case OB_FORMAT_NV21: {
-                cv::Mat rawMat(videoFrame->height() * 3 / 2, videoFrame->width(), CV_8UC1, videoFrame->data());
-                cv::cvtColor(rawMat, rstMat, cv::COLOR_YUV2RGB_NV21);
-            } break;
+            case OB_FORMAT_MJPG:
+                return mJpegDecoder.decode((const uint8_t *)videoFrame->data(), videoFrame->dataSize(), mCurrentSettings.mjpgDecodeScale, mCurrentSettings.colorPixelFormat, pix);
+            case OB_FORMAT_NV21:
+                return convertYUV(videoFrame, ofxOrbbec::YUV_NV21, pix, pyramid);
             case OB_FORMAT_YUYV:
-            case OB_FORMAT_YUY2: {
-                cv::Mat rawMat(videoFrame->height(), videoFrame->width(), CV_8UC2, videoFrame->data());
-                cv::cvtColor(rawMat, rstMat, cv::COLOR_YUV2RGB);
-            } break;
+            case OB_FORMAT_YUY2:
+                return convertYUV(videoFrame, ofxOrbbec::YUV_YUYV, pix, pyramid);
+            case OB_FORMAT_UYVY:
+                return convertYUV(videoFrame, ofxOrbbec::YUV_UYVY, pix, pyramid);
             case OB_FORMAT_RGB: {
-                cv::Mat rawMat(videoFrame->height(), videoFrame->width(), CV_8UC3, videoFrame->data());
-                rstMat = rawMat;
-            } break;
-            case OB_FORMAT_UYVY: {
-                cv::Mat rawMat(videoFrame->height(), videoFrame->width(), CV_8UC2, videoFrame->data());
-                cv::cvtColor(rawMat, rstMat, cv::COLOR_YUV2RGB_UYVY);
+                ofPixelFormat pixFormat = mCurrentSettings.colorPixelFormat;
+                auto region = ofxOrbbec::mapRegion(mCurrentSettings.colorRegion, videoFrame->width(), videoFrame->height(), getColorAlignX(OB_FORMAT_RGB));
+                if( !region.isFull(videoFrame->width(), videoFrame->height()) ){
+                    pix.allocate(region.outWidth, region.outHeight, pixFormat);
+                    ofxOrbbec::rgbToLayout((const uint8_t *)videoFrame->data(), videoFrame->width(), region, toPixelLayout(pixFormat), pix.getData());
+                }else if( pixFormat == OF_PIXELS_RGB ){
+                    pix.setFromPixels((unsigned char *)videoFrame->data(), videoFrame->width(), videoFrame->height(), 3);
+                }else{
+                    cv::Mat rawMat(videoFrame->height(), videoFrame->width(), CV_8UC3, videoFrame->data());
+                    pix.allocate(videoFrame->width(), videoFrame->height(), pixFormat);
+                    cv::Mat dstMat(videoFrame->height(), videoFrame->width(), pixFormat == OF_PIXELS_RGBA ? CV_8UC4 : CV_8UC3, pix.getData());
+                    cv::cvtColor(rawMat, dstMat, pixFormat == OF_PIXELS_RGBA ? cv::COLOR_RGB2RGBA : cv::COLOR_RGB2BGR);
+                }
+                return true;
             } break;
             default:
                 break;
             }
-            if(!rstMat.empty()) {
-                pix.setFromPixels(rstMat.ptr(), rstMat.cols, rstMat.rows, rstMat.channels());
-            }
         }
         else if(frame->type() == OB_FRAME_DEPTH) {
             auto videoFrame = frame->as<ob::VideoFrame>();
             if(videoFrame->format() == OB_FORMAT_Y16) {
-                cv::Mat cvtMat;
-                cv::Mat rawMat = cv::Mat(videoFrame->height(), videoFrame->width(), CV_16UC1, videoFrame->data());
                 // depth frame pixel value multiply scale to get distance in millimeter
                 float scale = videoFrame->as<ob::DepthFrame>()->getValueScale();
 
-                // threshold to 5.46m
-                cv::threshold(rawMat, cvtMat, 5460.0f / scale, 0, cv::THRESH_TRUNC);
-                cvtMat.convertTo(cvtMat, CV_8UC1, scale * 0.05);
-                rstMat = cvtMat;//cv::applyColorMap(cvtMat, rstMat, cv::COLORMAP_JET);
-            }
-            if(!rstMat.empty()) {
-                pix.setFromPixels(rstMat.ptr(), rstMat.cols, rstMat.rows, rstMat.channels());
-            }
-        }
-        else if(frame->type() == OB_FRAME_IR || frame->type() == OB_FRAME_IR_LEFT || frame->type() == OB_FRAME_IR_RIGHT) {
-            auto videoFrame = frame->as<ob::VideoFrame>();
-            if(videoFrame->format() == OB_FORMAT_Y16) {
-                cv::Mat cvtMat;
-                cv::Mat rawMat = cv::Mat(videoFrame->height(), videoFrame->width(), CV_16UC1, videoFrame->data());
-                rawMat.convertTo(cvtMat, CV_8UC1, 1.0 / 16.0f);
-                rstMat = rawMat;//cv::cvtColor(cvtMat, rstMat, cv::COLOR_GRAY2RGB);
-            }
-            else if(videoFrame->format() == OB_FORMAT_Y8) {
-                cv::Mat rawMat = cv::Mat(videoFrame->height(), videoFrame->width(), CV_8UC1, videoFrame->data());
-                rstMat = rawMat;//cv::cvtColor(rawMat * 2, rstMat, cv::COLOR_GRAY2RGB);
-            }
-            else if(videoFrame->format() == OB_FORMAT_MJPG) {
-#if !defined(TARGET_OSX) && !defined(TARGET_WIN32)
-                cv::Mat rawMat(1, videoFrame->dataSize(), CV_8UC1, videoFrame->data());
-                rstMat = cv::imdecode(rawMat, 1);
-                rstMat = rawMat;//cv::cvtColor(rstMat * 2, rstMat, cv::COLOR_GRAY2RGB);
-#else
-                ofLogError("ofxOrbbecCamera::processFrame") << " MJPG not supported - set IR format to OB_FORMAT_Y16 or OB_FORMAT_Y8 " << endl;
-#endif
-            }
-            if(!rstMat.empty()) {
-                pix.setFromPixels(rstMat.ptr(), rstMat.cols, rstMat.rows, rstMat.channels());
+                auto & settings = mCurrentSettings;
+                const ofColor & invalid = settings.depthPreviewInvalidColor;
+                uint8_t invalidColor[3] = {invalid.r, invalid.g, invalid.b};
+
+                auto region = ofxOrbbec::mapRegion(settings.depthRegion, videoFrame->width(), videoFrame->height());
+                pix.allocate(region.outWidth, region.outHeight, ofxOrbbec::getNumChannels(settings.depthPreviewColormap));
+                ofxOrbbec::depthToPreview((const uint16_t *)videoFrame->data(), videoFrame->width(), region, scale,
+                    settings.depthPreviewNear, settings.depthPreviewFar, settings.depthPreviewColormap, invalidColor, pix.getData());
+                return true;
             }
         }
     } catch(const cv::Exception& ex) {
         ofLogError("processFrame") << " OB_FORMAT not supported " << std::endl; 
     }
-    return pix; 
+    return false; 
 }
 
-void ofxOrbbecCamera::pointCloudToMesh(shared_ptr<ob::DepthFrame> depthFrame, shared_ptr<ob::ColorFrame> colorFrame){
-    if( depthFrame ){
-    
-		bool bRGB = false;
-		if(colorFrame){
-			bRGB = true;
-		}
-
-        int numPoints = 0;
-		uint32_t pointcloudSize = 0;
-		
-		 if(bRGB){
-			numPoints = colorFrame->width() * colorFrame->height();
-            pointcloudSize = numPoints * sizeof(OBColorPoint);
-        }else{
-			numPoints = depthFrame->width() * depthFrame->height();
-            pointcloudSize = numPoints * sizeof(OBPoint);
+//YUV straight into the output pixels in the configured layout, plus the pyramid levels in the same pass when given
+bool ofxOrbbecCamera::convertYUV(shared_ptr<ob::VideoFrame> videoFrame, ofxOrbbec::YUVFormat format, ofPixels & pix, ofPixels ** pyramid){
+    size_t w = videoFrame->width();
+    size_t h = videoFrame->height();
+    ofxOrbbec::PixelLayout layout = toPixelLayout(mCurrentSettings.colorPixelFormat);
+    //x stays even so chroma pairs line up
+    auto region = ofxOrbbec::mapRegion(mCurrentSettings.colorRegion, w, h, 2);
+    size_t outH = region.outHeight;
+
+    size_t outW = region.outWidth;
+    size_t channels = ofxOrbbec::getNumChannels(layout);
+    pix.allocate(outW, outH, mCurrentSettings.colorPixelFormat);
+    const uint8_t * src = (const uint8_t *)videoFrame->data();
+    uint8_t * dst = pix.getData();
+
+    uint8_t * half = nullptr, * quarter = nullptr;
+    if( pyramid && pyramid[0] ){
+        pyramid[0]->allocate(outW / 2, outH / 2, mCurrentSettings.colorPixelFormat);
+        half = pyramid[0]->getData();
+        if( pyramid[1] ){
+            pyramid[1]->allocate(outW / 4, outH / 4, mCurrentSettings.colorPixelFormat);
+            quarter = pyramid[1]->getData();
         }
-		
-		vector <uint8_t> pointcloudData;
-		if( mPointcloudData.size() != pointcloudSize){
-			mPointcloudData.resize(pointcloudSize);
-		}
-
-        mPointCloudMesh = ofMesh();
-        mPointCloudPts.clear();
-        mPointCloudPts.reserve(numPoints);
-        mPointCloudMesh.setMode(OF_PRIMITIVE_POINTS);
+    }
 
-        if( bRGB ){
-			OBColorPoint *point = (OBColorPoint *)&mPointcloudData[0];
-			ob::CoordinateTransformHelper::transformationDepthToRGBDPointCloud(&xyTables, depthFrame->data(), colorFrame->data(), point);
+    //convert 4 rows then reduce them while they're still in cache
+    auto convertRows = [&](size_t rowStart, size_t rowEnd){
+        if( !half ){
+            ofxOrbbec::yuvToRGB(format, src, w, h, region, rowStart, rowEnd, layout, dst);
+            return;
+        }
+        for(size_t row = rowStart; row < rowEnd; row += 4){
+            size_t numRows = std::min((size_t)4, rowEnd - row);
+            ofxOrbbec::yuvToRGB(format, src, w, h, region, row, row + numRows, layout, dst);
+            ofxOrbbec::pyramidStrip(dst + row * outW * channels, outW, numRows, channels, half + (row / 2) * (outW / 2) * channels,
+                quarter ? quarter + (row / 4) * (outW / 4) * channels : nullptr);
+        }
+    };
 
-			point = (OBColorPoint *)&mPointcloudData[0];
+    size_t minPixels = mCurrentSettings.colorParallelMinPixels;
+    int numBands = std::min(cv::getNumThreads(), (int)(outH / 16));
+    if( minPixels == 0 || outW * outH < minPixels || numBands < 2 ){
+        convertRows(0, outH);
+    }else{
+        //rows are independent so each band writes its own slice of pix - bands start on a multiple of 4 so the pyramid strips don't straddle them
+        cv::parallel_for_(cv::Range(0, numBands), [&](const cv::Range & range){
+            for(int band = range.start; band < range.end; band++){
+                size_t rowStart = (outH * band / numBands) & ~(size_t)3;
+                size_t rowEnd = band + 1 == numBands ? outH : (outH * (band + 1) / numBands) & ~(size_t)3;
+                convertRows(rowStart, rowEnd);
+            }
+        });
+    }
+    return true;
+}
 
-            std::vector <ofFloatColor> tColors;
-            tColors.reserve(numPoints);
+//for formats that can't do it during the conversion - one more read of the output straight after it was written
+void ofxOrbbecCamera::buildColorPyramid(const ofPixels & pix, ofPixels ** pyramid){
+    size_t w = pix.getWidth();
+    size_t h = pix.getHeight();
+    size_t channels = pix.getNumChannels();
 
-            for(int i = 0; i < numPoints; i++) {
-                auto pt = glm::vec3(point->x, -point->y, -point->z);
+    pyramid[0]->allocate(w / 2, h / 2, pix.getPixelFormat());
+    if( pyramid[1] ){
+        pyramid[1]->allocate(w / 4, h / 4, pix.getPixelFormat());
+    }
+    for(size_t row = 0; row < h; row += 4){
+        ofxOrbbec::pyramidStrip(pix.getData() + row * w * channels, w, std::min((size_t)4, h - row), channels, pyramid[0]->getData() + (row / 2) * (w / 2) * channels,
+            pyramid[1] ? pyramid[1]->getData() + (row / 4) * (w / 4) * channels : nullptr);
+    }
+}
 
-                mPointCloudPts.push_back(pt);
-                tColors.push_back(ofColor((int)point->r, (int)point->g, (int)point->b, 255));
+ofxOrbbec::FrameRef <ofxOrbbec::PointCloudData> ofxOrbbecCamera::pointCloudToMesh(shared_ptr<ob::DepthFrame> depthFrame, const ofPixels * colorPixels){
+    if( depthFrame && depthFrame->format() == OB_FORMAT_Y16 && xyTables.xTable ){
+        //the tables are on the depth grid, or the color grid when depth is aligned to color
+        size_t w = depthFrame->width();
+        size_t h = depthFrame->height();
+        if( (int)w != xyTables.width || (int)h != xyTables.height ){
+            return ofxOrbbec::FrameRef <ofxOrbbec::PointCloudData>();
+        }
 
-                point++;
-            }
-            mPointCloudMesh.addColors(tColors);
+        bool bRGB = colorPixels && colorPixels->isAllocated() && colorPixels->getNumChannels() >= 3;
+        auto region = ofxOrbbec::mapRegion(mCurrentSettings.depthRegion, w, h);
+        size_t numPoints = region.outWidth * region.outHeight;
 
-        }else{
-			OBPoint *point = (OBPoint *)&mPointcloudData[0];
-			ob::CoordinateTransformHelper::transformationDepthToPointCloud(&xyTables, depthFrame->data(), point);
+        auto cloud = mPointCloudPool.acquire();
+        setFrameInfo(*cloud, depthFrame);
+        auto & tMesh = cloud->data.mesh;
+        auto & tPts = cloud->data.points;
 
-			point = (OBPoint *)&mPointcloudData[0];
+        //write into the pooled storage in place - resize only allocates if the point count grows
+        tMesh.setMode(OF_PRIMITIVE_POINTS);
+        auto & tVerts = tMesh.getVertices();
+        tVerts.resize(numPoints);
+        tPts.resize(numPoints);
 
-            for(int i = 0; i < numPoints; i++) {
-                auto pt = glm::vec3(point->x, -point->y, -point->z);
+        const uint16_t * depth = (const uint16_t *)depthFrame->data();
+        float scale = depthFrame->getValueScale();
 
-                mPointCloudPts.push_back(pt);
-                point++;
+        //colors come from the color output, which may be decimated or MJPG scaled - sample it at the matching position
+        size_t colorChannels = 0, colorW = 0, colorH = 0;
+        size_t r = 0, b = 2;
+        if( bRGB ){
+            colorChannels = colorPixels->getNumChannels();
+            colorW = colorPixels->getWidth();
+            colorH = colorPixels->getHeight();
+            if( colorPixels->getPixelFormat() == OF_PIXELS_BGR ){
+                std::swap(r, b);
             }
         }
+        auto & tColors = tMesh.getColors();
+        if( bRGB ){
+            tColors.resize(numPoints);
+        }
 
-        mPointCloudMesh.addVertices(mPointCloudPts);
-        mPointCloudMesh.setupIndicesAuto(); 
+        //only the region is visited - the SDK helpers always do the whole frame
+        size_t i = 0;
+        for(size_t oy = 0; oy < region.outHeight; oy++){
+            size_t y = region.y + oy * region.step;
+            for(size_t ox = 0; ox < region.outWidth; ox++, i++){
+                size_t x = region.x + ox * region.step;
+                size_t index = y * w + x;
+                float d = depth[index] * scale;
+                float tx = xyTables.xTable[index];
+                float ty = xyTables.yTable[index];
+
+                glm::vec3 pt(0, 0, 0);
+                if( d > 0.0f && !std::isnan(tx) && !std::isnan(ty) ){
+                    pt = glm::vec3(tx * d, -ty * d, -d);
+                }
+                tPts[i] = pt;
+                tVerts[i] = pt;
 
-        if( lock() ){
-            mPointCloudMeshLocal = mPointCloudMesh; 
-            mPointCloudPtsLocal = mPointCloudPts;
-            if( bRGB ){
-                mInternalColorFrameNo++;
-            }else{
-                mInternalDepthFrameNo++;
+                if( bRGB ){
+                    const unsigned char * c = colorPixels->getData() + ( std::min(y * colorH / h, colorH - 1) * colorW + std::min(x * colorW / w, colorW - 1) ) * colorChannels;
+                    tColors[i] = ofFloatColor(c[r] / 255.0f, c[1] / 255.0f, c[b] / 255.0f, 1.0f);
+                }
             }
-            unlock();
         }
+
+        mPointCloudBuffer.back() = cloud;
+        mPointCloudBuffer.publish();
+        if( bRGB ){
+            mInternalColorFrameNo++;
+        }else{
+            mInternalDepthFrameNo++;
+        }
+        return cloud;
     }
+    return ofxOrbbec::FrameRef <ofxOrbbec::PointCloudData>();
 }
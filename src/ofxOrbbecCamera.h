@@ -4,47 +4,220 @@
 #include "libobsensor/hpp/Error.hpp"
 #include <opencv2/opencv.hpp>
 
+#include "ofxOrbbecTripleBuffer.h"
+#include "ofxOrbbecFramePool.h"
+#include "ofxOrbbecStreamWorker.h"
+#include "ofxOrbbecDecodePool.h"
+#include "ofxOrbbecSubscription.h"
+#include "ofxOrbbecConversions.h"
+#include "ofxOrbbecJpegDecoder.h"
+#include "ofxOrbbecH26XDecoder.h"   //OFXORBBEC_DECODE_H264_H265 is set in here
+#include "ofxOrbbecProfileNegotiator.h"
 
-//If you have ffmpeg / libavcodec included in your project uncomment below 
-//You can easily get the required libs from ofxFFmpegRTSP addon ( if you add it to your project )
-#define OFXORBBEC_DECODE_H264_H265
+namespace ofxOrbbec{
 
-// this allows us to decode the color video streams from Femto Mega over IP connection 
-#ifdef OFXORBBEC_DECODE_H264_H265
-    extern "C" {
-    #include <libavcodec/avcodec.h>
-    #include <libavformat/avformat.h>
-    #include <libswscale/swscale.h>
-    #include <libavutil/imgutils.h>
-    }
-#endif 
+enum CaptureMode{
+    CAPTURE_POLL,       //our own thread polls the pipeline with waitForFrames
+    CAPTURE_CALLBACK    //frames are processed on the SDK thread as soon as they are delivered
+};
 
-namespace ofxOrbbec{
+enum IRStream{
+    IR_MAIN,    //OB_SENSOR_IR
+    IR_LEFT,    //OB_SENSOR_IR_LEFT on stereo devices
+    IR_RIGHT,   //OB_SENSOR_IR_RIGHT on stereo devices
+    IR_NUM_STREAMS
+};
+
+enum PyramidLevel{
+    PYRAMID_HALF,       //1/2 width and height
+    PYRAMID_QUARTER,    //1/4
+    PYRAMID_NUM_LEVELS
+};
 
 struct Settings{
 
     struct FrameType{
         int requestWidth = 0; //needed
         int requestHeight = 0;//usually not needed, width is enough 
-        OBFormat format = OB_FORMAT_UNKNOWN; //DEPTH: OB_FORMAT_Y16 COLOR: OB_FORMAT_RGB or OB_FORMAT_MJPG 
+        OBFormat format = OB_FORMAT_UNKNOWN; //DEPTH: OB_FORMAT_Y16 COLOR: OB_FORMAT_RGB or OB_FORMAT_MJPG. UNKNOWN picks the cheapest to convert that fits the link
         int frameRate = 30;
     };
 
     std::string ip = "";
     int deviceID = 0;
     std::string deviceSerial = "";
+    std::string playbackFile = ""; //play a recording ( .bag ) instead of opening a device - relative paths are in bin/data
 
     OBRotateDegreeType rotation = OB_ROTATE_DEGREE_0;
 
+    CaptureMode captureMode = CAPTURE_POLL;
+
+    //run depth / point cloud and color decode on their own worker threads 
+    bool bThreadedStreams = false;
+    size_t streamQueueSize = 2; //framesets each worker can hold before dropping
+    DropPolicy streamDropPolicy = DROP_OLDEST;
+
+    //scheduling for the capture thread ( the SDK callback thread with CAPTURE_CALLBACK ) and the stream workers
+    std::string threadName = "ofxOrbbec"; //prefix for the thread names - on linux it is cut down so "<prefix> <role> <index>" fits in 15 chars
+    ThreadSettings captureThread;
+    ThreadSettings processingThreads;
+
+    //output buffers allocated up front in open() per stream - more are only added if the app holds on to many leases
+    size_t framePoolSize = 4;
+
     FrameType depthFrameSize;
     FrameType colorFrameSize; 
+
+    //depth outputs - only the enabled ones are computed
+    bool bDepthPreview = true;  //8-bit visualisation - getDepthPixels()
+    bool bDepthRaw = false;     //16-bit millimetres - getDepthPixelsRaw()
+    bool bDepthFloat = false;   //32-bit float metres, NaN with no depth - getDepthPixelsF(). Without it float depth is still made for subscriptions
+                                //with bDepthFloat and for depthFloatPullFrames frames after each getDepthFloatFrame() call, once per frame however many read it
+    int depthFloatPullFrames = 30;
+
+    //8-bit preview mapping - near maps to the start of the colormap, far to the end 
+    float depthPreviewNear = 0.0;   //mm
+    float depthPreviewFar = 5100.0; //mm
+    DepthColormap depthPreviewColormap = DEPTH_COLORMAP_GREY; //JET and TURBO give RGB pixels
+    ofColor depthPreviewInvalidColor = ofColor(0, 0, 0); //pixels with no depth
+    //only this part of the depth frame, every decimation-th pixel, is converted - all depth outputs and the point cloud use it
+    Region depthRegion;
+    //1 adds a 1/2 size millimetre depth output, 2 adds 1/4 as well - reduced while the full size rows are converted
+    int depthPyramidLevels = 0;
+    DepthReduce depthPyramidReduce = DEPTH_REDUCE_MIN;
+
+    //color output - OF_PIXELS_RGB, OF_PIXELS_BGR ( OpenCV order ) or OF_PIXELS_RGBA ( ready for a 4 byte texture upload )
+    ofPixelFormat colorPixelFormat = OF_PIXELS_RGB;
+    //YUV color frames with at least this many pixels are converted in row bands across OpenCV's thread pool - 0 never splits
+    size_t colorParallelMinPixels = 1920 * 1080;
+    //MJPG color is decoded at 1 / scale ( 1, 2, 4 or 8 ) - the downscale happens in the DCT so preview decodes are much cheaper
+    int mjpgDecodeScale = 1;
+    //more than 1 decodes consecutive MJPG frames in parallel on this many threads - they are still delivered in order
+    size_t mjpgDecodeThreads = 1;
+    //H.264 / H.265 color ( Femto Mega over the network ) - decoder threading and how the decoded YUV is upsampled to RGB
+    //threadCount 1 with slice threading is the lowest latency, more threads with frame threading the highest throughput
+    //output H26X_OUTPUT_PLANES skips the RGB conversion and hands out the decoder's YUV planes ( no color pixels, pyramid or RGB point cloud )
+    //each frameset is published once its own frame's picture is out, so it carries the decoder's delay - one without a picture ( dropped / skipped ) has no color.
+    //Streams with B-frames decode out of order - framesets are held back until the ones before them are done, which adds the reorder delay
+    H26XSettings h26x;
+    //OB_FORMAT_RGB with OF_PIXELS_RGB only - color pixels point straight at the SDK frame instead of being copied.
+    //The SDK frame stays referenced while the pool buffer wrapping it is ( up to framePoolSize frames )
+    bool bColorZeroCopy = false;
+    //H.264, H.265 and MJPG color are only decoded while something reads color - a getColor*() getter, getFrameSet(), waitForFrameSet() or
+    //waitForNewFrame() called in the last colorPullFrames framesets, a newFrameSetEvent listener, a subscription with bColor or bPointCloudRGB.
+    //Otherwise framesets carry no color, for boxes that only record / relay with subscribeCompressed(). Depth only consumers that want
+    //framesets without turning color on should subscribe() with bColor = false
+    bool bDecodeColorOnDemand = false;
+    int colorPullFrames = 30;
+    //crop / decimate uncompressed color ( RGB and YUV ) while converting - use mjpgDecodeScale for MJPG. Turns off bColorZeroCopy unless it's the whole frame
+    Region colorRegion;
+    //same for color, 2x2 averaged - built in the same pass for YUV, straight after the decode / copy for the other formats
+    int colorPyramidLevels = 0;
     
+    //IR streams - processed with depth on the same stage
+    FrameType irFrameSize;          //used for every enabled IR stream
+    bool bIRPreview = true;         //8-bit with percentile auto gain - getIRPixels()
+    bool bIRRaw = false;            //16-bit as delivered ( Y16 only ) - getIRPixelsRaw()
+    float irGainLowPercentile = 1.0;    //percent of pixels that map to black
+    float irGainHighPercentile = 99.5;  //percent of pixels below white - keep it high so markers don't set the range
+    Region irRegion;                //Y8 / Y16 IR only, the gain is computed from the region too
+
     bool bColor = false;
     bool bDepth = false; 
+    bool bIR = false;
+    bool bIRLeft = false;
+    bool bIRRight = false;
     bool bPointCloud = false; 
     bool bPointCloudRGB = false; 
 };
 
+struct StreamStats{
+    uint64_t numFrames = 0;
+    uint64_t numDropped = 0; //only with bThreadedStreams
+    //host receive time to end of processing 
+    float lastLatencyMs = 0.0;
+    float avgLatencyMs = 0.0;
+    float maxLatencyMs = 0.0;
+};
+
+struct CaptureStats{
+    uint64_t numFrameSets = 0;
+    StreamStats depth;
+    StreamStats color;
+    StreamStats ir[IR_NUM_STREAMS];
+};
+
+struct PointCloudData{
+    ofMesh mesh;
+    std::vector <glm::vec3> points;
+};
+
+//every product of one ob::FrameSet, published together once all of its stages are done
+//FrameData::index and the timestamps are those of the FrameSet
+struct FrameSetData{
+    FrameRef <ofPixels> depth;
+    FrameRef <ofShortPixels> depthRaw;
+    FrameRef <ofFloatPixels> depthFloat;
+    FrameRef <ofPixels> color;
+    FrameRef <PointCloudData> pointCloud;
+    FrameRef <ofPixels> ir[IR_NUM_STREAMS];
+    FrameRef <ofShortPixels> irRaw[IR_NUM_STREAMS];
+    FrameRef <ofPixels> colorPyramid[PYRAMID_NUM_LEVELS];
+    FrameRef <ofShortPixels> depthPyramid[PYRAMID_NUM_LEVELS];
+    FrameRef <YUVPlanes> colorPlanes;
+
+    std::atomic <int> numPendingStages {0}; //internal - stages still writing to this frameset
+};
+
+//a color frame exactly as the camera sent it - FrameData::source holds the SDK frame data points into
+struct CompressedFrame{
+    OBFormat format = OB_FORMAT_UNKNOWN;    //OB_FORMAT_H264, OB_FORMAT_H265 or OB_FORMAT_MJPG
+    const uint8_t * data = nullptr;
+    size_t size = 0;
+    int width = 0;
+    int height = 0;
+    bool bKeyFrame = false;                 //decoding / a new recording can start here - always true for MJPG
+};
+
+//internal - outputs and auto gain of one IR stream
+struct IRStreamState{
+    FramePool <ofPixels> pool;
+    FramePool <ofShortPixels> rawPool;
+    TripleBuffer <FrameRef<ofPixels>> buffer;
+    TripleBuffer <FrameRef<ofShortPixels>> rawBuffer;
+    AutoGainState autoGain;
+    JpegDecoder jpegDecoder;
+    ProfileChoice profile;
+};
+
+//internal - the 1/2 and 1/4 outputs of one stream
+template <typename PixelsType>
+struct PyramidState{
+    FramePool <PixelsType> pool[PYRAMID_NUM_LEVELS];
+    TripleBuffer <FrameRef<PixelsType>> buffer[PYRAMID_NUM_LEVELS];
+};
+
+typedef FrameRef <FrameSetData> FrameSetRef;
+typedef Subscription <FrameSetRef> FrameSetSubscription;
+typedef FrameRef <CompressedFrame> CompressedFrameRef;
+typedef Subscription <CompressedFrameRef> CompressedSubscription;
+
+//what each processing stage gets handed for one frameset
+struct StreamJob{
+    std::shared_ptr<ob::FrameSet> frameSet;
+    std::shared_ptr<FrameData<FrameSetData>> frameSetData;
+    std::shared_ptr<FrameData<ofPixels>> color; //decoded but not published yet
+    std::shared_ptr<FrameData<ofPixels>> colorPyramid[PYRAMID_NUM_LEVELS];
+    std::shared_ptr<FrameData<YUVPlanes>> colorPlanes;
+};
+
+//internal - a frameset whose color stage is waiting on the H.264 / H.265 decode thread for its picture
+struct H26XJob{
+    H26XPacket packet;
+    StreamJob job;
+    bool bDone = false;     //its picture is in ( or isn't coming ) - finished once everything before it is
+};
+
 };
 
 
@@ -68,61 +241,191 @@ class ofxOrbbecCamera : public ofThread{
         bool isFrameNewColor();
         bool isFrameNewIR();
 
-        ofPixels getDepthPixels();
-        ofFloatPixels getDepthPixelsF(); 
-        ofPixels getColorPixels(); 
+        //each getter keeps its own lease on the frame it returned - the reference stays valid until that same getter
+        //is called again ( or close() ), whatever the other getters do. getPointCloud() and getPointCloudMesh() count as separate getters
+        //getters should all be called from the same thread ( usually the main thread )
+        const ofPixels & getDepthPixels();
+        const ofShortPixels & getDepthPixelsRaw(); 
+        const ofFloatPixels & getDepthPixelsF(); 
+        const ofPixels & getColorPixels(); 
+        
+        const ofPixels & getIRPixels(ofxOrbbec::IRStream stream = ofxOrbbec::IR_MAIN);
+        const ofShortPixels & getIRPixelsRaw(ofxOrbbec::IRStream stream = ofxOrbbec::IR_MAIN);
         
-        std::vector <glm::vec3> getPointCloud(); 
-        ofMesh getPointCloudMesh();
+        const std::vector <glm::vec3> & getPointCloud(); 
+        const ofMesh & getPointCloudMesh();
+
+        //zero-copy leases on the latest frames - read in place for as long as you hold the ref
+        //the buffer returns to the pool when the last ref is released
+        ofxOrbbec::FrameRef <ofPixels> getDepthFrame();
+        ofxOrbbec::FrameRef <ofShortPixels> getDepthRawFrame();
+        ofxOrbbec::FrameRef <ofFloatPixels> getDepthFloatFrame();
+        ofxOrbbec::FrameRef <ofPixels> getColorFrame();
+        ofxOrbbec::FrameRef <ofxOrbbec::PointCloudData> getPointCloudFrame();
+        ofxOrbbec::FrameRef <ofPixels> getIRFrame(ofxOrbbec::IRStream stream = ofxOrbbec::IR_MAIN);
+        ofxOrbbec::FrameRef <ofShortPixels> getIRRawFrame(ofxOrbbec::IRStream stream = ofxOrbbec::IR_MAIN);
+        //colorPyramidLevels / depthPyramidLevels - empty for levels that weren't asked for
+        ofxOrbbec::FrameRef <ofPixels> getColorPyramidFrame(ofxOrbbec::PyramidLevel level = ofxOrbbec::PYRAMID_HALF);
+        ofxOrbbec::FrameRef <ofShortPixels> getDepthPyramidFrame(ofxOrbbec::PyramidLevel level = ofxOrbbec::PYRAMID_HALF);
+        //H.264 / H.265 color with h26x.output PLANES or PIXELS_AND_PLANES - the decoder's YUV, pointing into its own buffers
+        ofxOrbbec::FrameRef <ofxOrbbec::YUVPlanes> getColorPlanesFrame();
+
+        //all outputs of the latest complete frameset - depth, color and point cloud always match
+        //a frameset where a threaded stream dropped its part is never published 
+        ofxOrbbec::FrameSetRef getFrameSet();
+
+        //block until the next frameset is published or timeoutMs passes - safe to call from any thread
+        bool waitForNewFrame(uint64_t timeoutMs);
+        ofxOrbbec::FrameSetRef waitForFrameSet(uint64_t timeoutMs);
+
+        //every consumer gets its own queue - latest only or FIFO with block / drop and its own drop counters.
+        //Framesets arrive in the order they complete - with bThreadedStreams that can be out of index order, check FrameData::index
+        //the subscription ends when the returned pointer is released or passed to unsubscribe()
+        std::shared_ptr <ofxOrbbec::FrameSetSubscription> subscribe(const ofxOrbbec::SubscriptionSettings & settings = ofxOrbbec::SubscriptionSettings());
+        void unsubscribe(std::shared_ptr <ofxOrbbec::FrameSetSubscription> subscription);
+
+        //H.264 / H.265 / MJPG color payloads as delivered, never decoded - for recording and relaying. Delivered from the capture thread
+        //before any decode, each frame keeps its SDK frame referenced until released. Pair with bDecodeColorOnDemand to skip decoding entirely
+        std::shared_ptr <ofxOrbbec::CompressedSubscription> subscribeCompressed(const ofxOrbbec::SubscriptionSettings & settings = ofxOrbbec::SubscriptionSettings());
+        void unsubscribe(std::shared_ptr <ofxOrbbec::CompressedSubscription> subscription);
+
+        //fired on the capture / worker thread as soon as a frameset is complete - keep listeners short
+        ofEvent <ofxOrbbec::FrameSetRef> newFrameSetEvent;
+
+        ofxOrbbec::CaptureStats getCaptureStats();
+        //CPU time used by the capture thread and each stream worker
+        std::vector <ofxOrbbec::ThreadStats> getThreadStats();
+        //the stream profiles open() settled on and why
+        const ofxOrbbec::ProfileChoice & getDepthProfile() const;
+        const ofxOrbbec::ProfileChoice & getColorProfile() const;
+        const ofxOrbbec::ProfileChoice & getIRProfile(ofxOrbbec::IRStream stream = ofxOrbbec::IR_MAIN) const;
+
+        //throughput of each MJPG decode thread ( mjpgDecodeThreads > 1 )
+        std::vector <ofxOrbbec::DecodeWorkerStats> getDecodeStats();
+        //H.264 / H.265 color - pictures out, packets skipped after a drop and packet to picture latency
+        ofxOrbbec::H26XStats getH26XStats();
 
     protected:
         void threadedFunction() override; 
         void clear(); 
+
+        void processFrameSet(shared_ptr<ob::FrameSet> frameSet);
+        void processDepthFrameSet(ofxOrbbec::StreamJob & job);
+        void processColorFrameSet(ofxOrbbec::StreamJob & job);
+        void decodeColor(ofxOrbbec::StreamJob & job, ofxOrbbec::JpegDecoder & jpegDecoder);
+        void publishColor(ofxOrbbec::StreamJob & job);
+        bool queueH26XPacket(ofxOrbbec::StreamJob & job);
+        void decodeH26XPacket(ofxOrbbec::H26XJob & h26xJob);
+        void decodeH26XPicture(const ofxOrbbec::H26XPicture & picture, ofxOrbbec::StreamJob & job);
+        void finishH26XJob(ofxOrbbec::H26XJob & pending);
+        void finishH26XJobs(uint64_t seq);
+        void finishStage(ofxOrbbec::StreamJob & job);
+        void updateStreamStats(ofxOrbbec::StreamStats & stats, shared_ptr<ob::Frame> frame);
         
-        ofPixels processFrame(shared_ptr<ob::Frame> frame);
-		void pointCloudToMesh(shared_ptr<ob::DepthFrame> depthFrame, shared_ptr<ob::ColorFrame> colorFrame = shared_ptr<ob::ColorFrame>() );
+        bool processFrame(shared_ptr<ob::Frame> frame, ofPixels & pix, ofPixels ** pyramid = nullptr);
+        bool convertYUV(shared_ptr<ob::VideoFrame> videoFrame, ofxOrbbec::YUVFormat format, ofPixels & pix, ofPixels ** pyramid = nullptr);
+        void buildColorPyramid(const ofPixels & pix, ofPixels ** pyramid);
+        void processDepthRaw(shared_ptr<ob::DepthFrame> depthFrame, bool bFloat, ofxOrbbec::FrameSetData & products);
+        bool isDepthFloatWanted();
+        bool isColorDecodeWanted();
+        void markColorPulled();
+        void updateSubscriptionCounts();
+        void publishCompressed(shared_ptr<ob::FrameSet> frameSet);
+        void processIRFrame(ofxOrbbec::IRStream stream, shared_ptr<ob::VideoFrame> irFrame, ofxOrbbec::FrameSetData & products);
+        bool isIREnabled(ofxOrbbec::IRStream stream) const;
+        bool hasDepthStage() const;
+		ofxOrbbec::FrameRef <ofxOrbbec::PointCloudData> pointCloudToMesh(shared_ptr<ob::DepthFrame> depthFrame, const ofPixels * colorPixels = nullptr);
 
         ofxOrbbec::Settings mCurrentSettings;
+        ofxOrbbec::CaptureStats mCaptureStats;
+        ofxOrbbec::ProfileChoice mDepthProfileChoice, mColorProfileChoice;
+
+        ofxOrbbec::StreamWorker <ofxOrbbec::StreamJob> mDepthWorker, mColorWorker;
+        ofxOrbbec::ThreadHandle mCaptureThreadHandle;
+
+        //parallel MJPG decode - one decoder per thread
+        ofxOrbbec::DecodePool <ofxOrbbec::StreamJob> mColorDecodePool;
+        std::vector <std::unique_ptr<ofxOrbbec::JpegDecoder>> mJpegDecoders;
         
         bool bNewFrameColor, bNewFrameDepth, bNewFrameIR = false; 
         
-        unsigned int mInternalDepthFrameNo = 0;
-		unsigned int mInternalColorFrameNo = 0;
+        //written by the capture thread after a buffer is published
+        std::atomic <unsigned int> mInternalDepthFrameNo {0};
+		std::atomic <unsigned int> mInternalColorFrameNo {0};
+        std::atomic <unsigned int> mInternalIRFrameNo {0};
 		unsigned int mExtDepthFrameNo = 0;
 		unsigned int mExtColorFrameNo = 0;
+        unsigned int mExtIRFrameNo = 0;
 
-        ofPixels mDepthPixels, mColorPixels; 
-        ofFloatPixels mDepthPixelsF;
+        ofxOrbbec::FramePool <ofPixels> mDepthPool, mColorPool;
+        ofxOrbbec::FramePool <ofShortPixels> mDepthRawPool;
+        ofxOrbbec::FramePool <ofFloatPixels> mDepthFloatPool;
+        ofxOrbbec::FramePool <ofxOrbbec::PointCloudData> mPointCloudPool;
+        ofxOrbbec::TripleBuffer <ofxOrbbec::FrameRef<ofPixels>> mDepthBuffer, mColorBuffer; 
+        ofxOrbbec::TripleBuffer <ofxOrbbec::FrameRef<ofShortPixels>> mDepthRawBuffer; 
+        ofxOrbbec::TripleBuffer <ofxOrbbec::FrameRef<ofFloatPixels>> mDepthFloatBuffer; 
+        ofxOrbbec::TripleBuffer <ofxOrbbec::FrameRef<ofxOrbbec::PointCloudData>> mPointCloudBuffer; 
+        ofxOrbbec::IRStreamState mIR[ofxOrbbec::IR_NUM_STREAMS];
+        ofxOrbbec::PyramidState <ofPixels> mColorPyramid;
+        ofxOrbbec::PyramidState <ofShortPixels> mDepthPyramid;
+        std::vector <uint16_t> mDepthStrip; //mm rows for the depth pyramid when bDepthRaw is off
 
-        ofMesh mPointCloudMesh; 
-        ofMesh mPointCloudMeshLocal;
-        vector <glm::vec3> mPointCloudPts;
-        vector <glm::vec3> mPointCloudPtsLocal;
+        //the last stage to finish publishes so this side can have two producers 
+        ofxOrbbec::FramePool <ofxOrbbec::FrameSetData> mFrameSetPool;
+        ofxOrbbec::TripleBuffer <ofxOrbbec::FrameSetRef> mFrameSetBuffer;
+        std::mutex mFrameSetPublishMutex;
 
-		std::shared_ptr <ob::Pipeline> mPipe;
-   		std::shared_ptr <ob::PointCloudFilter> pointCloud;
-   		std::shared_ptr <ob::Context> ctxLocal;
-
-        #ifdef OFXORBBEC_DECODE_H264_H265 
+        //for waitForNewFrame - guarded by mFrameSetWaitMutex
+        std::mutex mFrameSetWaitMutex;
+        std::condition_variable mFrameSetCondition;
+        ofxOrbbec::FrameSetRef mLatestFrameSet;
+        uint64_t mFrameSetSeq = 0;
 
-            bool bInitOneTime = false; 
+        std::mutex mSubscriptionMutex;
+        std::vector <std::weak_ptr <ofxOrbbec::FrameSetSubscription>> mSubscriptions;
+        std::vector <std::shared_ptr <ofxOrbbec::FrameSetSubscription>> mSubscriptionSnapshot; //under mFrameSetPublishMutex
+        std::atomic <int> mNumDepthFloatSubscriptions {0};
+        std::atomic <int> mNumColorSubscriptions {0};
+        std::atomic <int> mDepthFloatPullFrames {0};  //depth frames left before a getDepthFloatFrame() read stops keeping float depth on
+        std::atomic <int> mColorPullFrames {0};       //framesets left before a color / frameset read stops keeping color decoding on
 
-            AVCodec* codec264 = nullptr;
-            AVCodecContext* codecContext264 = nullptr;
+        std::mutex mCompressedMutex;
+        std::vector <std::weak_ptr <ofxOrbbec::CompressedSubscription>> mCompressedSubscriptions;
+        std::vector <std::shared_ptr <ofxOrbbec::CompressedSubscription>> mCompressedSnapshot; //capture thread only
+        ofxOrbbec::FramePool <ofxOrbbec::CompressedFrame> mCompressedPool;
 
-            AVCodec* codec265 = nullptr;
-            AVCodecContext* codecContext265 = nullptr;
+        //held for the reference getters above, one per getter
+        ofxOrbbec::FrameRef <ofPixels> mDepthPixelsLease, mColorPixelsLease;
+        ofxOrbbec::FrameRef <ofShortPixels> mDepthRawLease;
+        ofxOrbbec::FrameRef <ofFloatPixels> mDepthFloatLease;
+        ofxOrbbec::FrameRef <ofPixels> mIRPixelsLease[ofxOrbbec::IR_NUM_STREAMS];
+        ofxOrbbec::FrameRef <ofShortPixels> mIRRawLease[ofxOrbbec::IR_NUM_STREAMS];
+        ofxOrbbec::FrameRef <ofxOrbbec::PointCloudData> mPointCloudLease, mPointCloudMeshLease;
 
-            SwsContext* swsContext = nullptr;
+        //returned by the getters before the first frame arrives
+        ofPixels mEmptyPixels;
+        ofShortPixels mEmptyShortPixels;
+        ofFloatPixels mEmptyFloatPixels;
+        ofxOrbbec::PointCloudData mEmptyPointCloud;
 
-            void initH26XCodecs();
-            ofPixels decodeH26XFrame(uint8_t * myData, int dataSize, bool bH264);
+		std::shared_ptr <ob::Pipeline> mPipe;
+   		std::shared_ptr <ob::Context> ctxLocal;
 
-        #endif
+        //H.264 / H.265 color - packets are decoded on their own thread, each frameset gets the picture decoded from its own frame
+        ofxOrbbec::H26XDecoder mH26XDecoder;
+        ofxOrbbec::StreamWorker <ofxOrbbec::H26XJob> mH26XWorker;
+        uint64_t mH26XSeq = 0;
+        std::vector <ofxOrbbec::H26XJob> mH26XPending;     //H.26x thread only - framesets waiting on their picture, by packet seq
+        uint64_t mH26XLastSeq = 0;                          //H.26x thread only
+        uint64_t mH26XFinishSeq = 1;                        //H.26x thread only - oldest frameset not finished yet
+        ofxOrbbec::FramePool <ofxOrbbec::YUVPlanes> mColorPlanesPool;
+        ofxOrbbec::TripleBuffer <ofxOrbbec::FrameRef<ofxOrbbec::YUVPlanes>> mColorPlanesBuffer;
         
-        OBXYTables xyTables;
+        //MJPG decoder for the color stage when it isn't using the decode pool
+        ofxOrbbec::JpegDecoder mJpegDecoder;
+
+        OBXYTables xyTables = {};
         vector <float> xyTableData;
-        vector <uint8_t> mPointcloudData;
         bool bConnected = false; 
         float mTimeSinceFrame = 0; 
 
@@ -0,0 +1,863 @@
+#include "ofxOrbbecConversions.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define OFXORBBEC_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define OFXORBBEC_SSE2
+    #if defined(__SSSE3__) || defined(__AVX2__)
+        #include <tmmintrin.h>
+        #define OFXORBBEC_SSSE3
+    #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define OFXORBBEC_NEON
+#endif
+
+namespace ofxOrbbec{
+
+size_t getNumChannels(DepthColormap colormap){
+    if( colormap == DEPTH_COLORMAP_JET || colormap == DEPTH_COLORMAP_TURBO ){
+        return 3;
+    }
+    return 1;
+}
+
+size_t getNumChannels(PixelLayout layout){
+    return layout == LAYOUT_RGBA ? 4 : 3;
+}
+
+RegionMap mapRegion(const Region & region, size_t srcWidth, size_t srcHeight, size_t alignX){
+    RegionMap map;
+    map.step = std::max(region.decimation, 1);
+    map.x = std::min((size_t)std::max(region.x, 0), srcWidth) / alignX * alignX;
+    map.y = std::min((size_t)std::max(region.y, 0), srcHeight);
+
+    size_t w = srcWidth - map.x;
+    size_t h = srcHeight - map.y;
+    if( region.width > 0 ){
+        w = std::min(w, (size_t)region.width);
+    }
+    if( region.height > 0 ){
+        h = std::min(h, (size_t)region.height);
+    }
+    map.outWidth = (w + map.step - 1) / map.step;
+    map.outHeight = (h + map.step - 1) / map.step;
+    return map;
+}
+
+bool RegionMap::isFull(size_t srcWidth, size_t srcHeight) const{
+    return step == 1 && x == 0 && y == 0 && outWidth == srcWidth && outHeight == srcHeight;
+}
+
+// Calls run(src, n, outOffset) over the region in contiguous runs.
+// Whole frames are one run, decimated rows are gathered through a small buffer that stays in L1.
+template <typename T, typename Run>
+static void forEachRun(const T * src, size_t srcWidth, const RegionMap & region, Run run){
+    if( region.step == 1 && region.x == 0 && region.outWidth == srcWidth ){
+        run(src + region.y * srcWidth, region.outWidth * region.outHeight, 0);
+        return;
+    }
+
+    const size_t chunk = 1024;
+    T gather[chunk];
+    for(size_t r = 0; r < region.outHeight; r++){
+        const T * row = src + (region.y + r * region.step) * srcWidth + region.x;
+        size_t outOffset = r * region.outWidth;
+        if( region.step == 1 ){
+            run(row, region.outWidth, outOffset);
+            continue;
+        }
+        for(size_t c = 0; c < region.outWidth; c += chunk){
+            size_t n = std::min(chunk, region.outWidth - c);
+            const T * s = row + c * region.step;
+            for(size_t i = 0; i < n; i++){
+                gather[i] = s[i * region.step];
+            }
+            run(gather, n, outOffset + c);
+        }
+    }
+}
+
+static void depthToMillimetres(const uint16_t * src, size_t n, float valueScale, uint16_t * dst){
+    //most devices already deliver mm
+    if( valueScale == 1.0f ){
+        memcpy(dst, src, n * sizeof(uint16_t));
+        return;
+    }
+    for(size_t i = 0; i < n; i++){
+        float mm = src[i] * valueScale;
+        dst[i] = (uint16_t)std::min(mm + 0.5f, 65535.0f);
+    }
+}
+
+//0 is no depth - it becomes NaN so it can't be mistaken for a point at the camera
+static void depthToMetres(const uint16_t * src, size_t n, float valueScale, float * dst){
+    const float scale = valueScale * 0.001f;
+    size_t i = 0;
+
+#if defined(OFXORBBEC_AVX2)
+    {
+        const __m256 vs = _mm256_set1_ps(scale);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 nan = _mm256_set1_ps(NAN);
+
+        for(; i + 16 <= n; i += 16){
+            __m256i raw = _mm256_loadu_si256((const __m256i *)(src + i));
+            __m256 lo = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(raw))), vs);
+            __m256 hi = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(raw, 1))), vs);
+            //+0.0 has no bits set so or-ing in the NaN pattern replaces it
+            lo = _mm256_or_ps(lo, _mm256_and_ps(_mm256_cmp_ps(lo, zero, _CMP_EQ_OQ), nan));
+            hi = _mm256_or_ps(hi, _mm256_and_ps(_mm256_cmp_ps(hi, zero, _CMP_EQ_OQ), nan));
+            _mm256_storeu_ps(dst + i, lo);
+            _mm256_storeu_ps(dst + i + 8, hi);
+        }
+    }
+#endif
+
+#if defined(OFXORBBEC_SSE2)
+    {
+        const __m128 vs = _mm_set1_ps(scale);
+        const __m128i zeroi = _mm_setzero_si128();
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 nan = _mm_set1_ps(NAN);
+
+        for(; i + 8 <= n; i += 8){
+            __m128i raw = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128 lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, zeroi)), vs);
+            __m128 hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(raw, zeroi)), vs);
+            lo = _mm_or_ps(lo, _mm_and_ps(_mm_cmpeq_ps(lo, zero), nan));
+            hi = _mm_or_ps(hi, _mm_and_ps(_mm_cmpeq_ps(hi, zero), nan));
+            _mm_storeu_ps(dst + i, lo);
+            _mm_storeu_ps(dst + i + 4, hi);
+        }
+    }
+#elif defined(OFXORBBEC_NEON)
+    {
+        const float32x4_t vs = vdupq_n_f32(scale);
+        const uint16x8_t zero = vdupq_n_u16(0);
+        const float32x4_t nan = vdupq_n_f32(NAN);
+
+        for(; i + 8 <= n; i += 8){
+            uint16x8_t raw = vld1q_u16(src + i);
+            uint16x8_t inv = vceqq_u16(raw, zero);
+            float32x4_t lo = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(raw))), vs);
+            float32x4_t hi = vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(raw))), vs);
+            //sign extend so the 16 bit all ones mask stays all ones
+            int16x8_t inv16 = vreinterpretq_s16_u16(inv);
+            lo = vbslq_f32(vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(inv16))), nan, lo);
+            hi = vbslq_f32(vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(inv16))), nan, hi);
+            vst1q_f32(dst + i, lo);
+            vst1q_f32(dst + i + 4, hi);
+        }
+    }
+#endif
+
+    for(; i < n; i++){
+        dst[i] = src[i] ? src[i] * scale : NAN;
+    }
+}
+
+void convertDepthY16(const uint16_t * src, size_t numPixels, float valueScale, uint16_t * dstMillimetres, float * dstMetres){
+    //in blocks so the source is still in L1 for the second output
+    const size_t blockSize = 4096;
+    for(size_t start = 0; start < numPixels; start += blockSize){
+        size_t n = std::min(blockSize, numPixels - start);
+        if( dstMillimetres ){
+            depthToMillimetres(src + start, n, valueScale, dstMillimetres + start);
+        }
+        if( dstMetres ){
+            depthToMetres(src + start, n, valueScale, dstMetres + start);
+        }
+    }
+}
+
+void copyRegion(const uint8_t * src, size_t srcWidth, const RegionMap & region, uint8_t * dst){
+    forEachRun(src, srcWidth, region, [&](const uint8_t * s, size_t n, size_t offset){
+        memcpy(dst + offset, s, n);
+    });
+}
+
+void copyRegion(const uint16_t * src, size_t srcWidth, const RegionMap & region, uint16_t * dst){
+    forEachRun(src, srcWidth, region, [&](const uint16_t * s, size_t n, size_t offset){
+        memcpy(dst + offset, s, n * sizeof(uint16_t));
+    });
+}
+
+void rgbToLayout(const uint8_t * src, size_t srcWidth, const RegionMap & region, PixelLayout layout, uint8_t * dst){
+    size_t channels = getNumChannels(layout);
+    for(size_t r = 0; r < region.outHeight; r++){
+        const uint8_t * s = src + ((region.y + r * region.step) * srcWidth + region.x) * 3;
+        uint8_t * d = dst + r * region.outWidth * channels;
+        if( layout == LAYOUT_RGB && region.step == 1 ){
+            memcpy(d, s, region.outWidth * 3);
+            continue;
+        }
+        size_t stride = region.step * 3;
+        for(size_t c = 0; c < region.outWidth; c++, s += stride, d += channels){
+            d[0] = layout == LAYOUT_BGR ? s[2] : s[0];
+            d[1] = s[1];
+            d[2] = layout == LAYOUT_BGR ? s[0] : s[2];
+            if( channels == 4 ){
+                d[3] = 255;
+            }
+        }
+    }
+}
+
+//one row of 2x2 means from two source rows
+static void halveRow(const uint8_t * row0, const uint8_t * row1, size_t outWidth, size_t channels, uint8_t * dst){
+    for(size_t x = 0; x < outWidth; x++){
+        for(size_t c = 0; c < channels; c++){
+            dst[c] = (row0[c] + row0[c + channels] + row1[c] + row1[c + channels] + 2) >> 2;
+        }
+        row0 += channels * 2;
+        row1 += channels * 2;
+        dst += channels;
+    }
+}
+
+void pyramidStrip(const uint8_t * src, size_t width, size_t numRows, size_t channels, uint8_t * half, uint8_t * quarter){
+    size_t halfWidth = width / 2;
+    size_t rowBytes = width * channels;
+    size_t halfBytes = halfWidth * channels;
+
+    for(size_t r = 0; r + 1 < numRows; r += 2){
+        halveRow(src + r * rowBytes, src + (r + 1) * rowBytes, halfWidth, channels, half + (r / 2) * halfBytes);
+    }
+    if( quarter && numRows >= 4 ){
+        halveRow(half, half + halfBytes, halfWidth / 2, channels, quarter);
+    }
+}
+
+static inline uint16_t reduceDepth4(uint16_t a, uint16_t b, uint16_t c, uint16_t d, DepthReduce reduce){
+    if( reduce == DEPTH_REDUCE_MIN ){
+        //0 wraps to the largest value so it only wins when all four are invalid
+        uint16_t m = std::min(std::min((uint16_t)(a - 1), (uint16_t)(b - 1)), std::min((uint16_t)(c - 1), (uint16_t)(d - 1)));
+        return m + 1;
+    }
+
+    uint16_t v[4] = {a, b, c, d};
+    if( reduce == DEPTH_REDUCE_MEAN ){
+        uint32_t sum = 0, count = 0;
+        for(int i = 0; i < 4; i++){
+            sum += v[i];
+            count += v[i] ? 1 : 0;
+        }
+        return count ? (sum + count / 2) / count : 0;
+    }
+
+    //sorting network - invalid pixels end up first
+    if( v[0] > v[1] ) std::swap(v[0], v[1]);
+    if( v[2] > v[3] ) std::swap(v[2], v[3]);
+    if( v[0] > v[2] ) std::swap(v[0], v[2]);
+    if( v[1] > v[3] ) std::swap(v[1], v[3]);
+    if( v[1] > v[2] ) std::swap(v[1], v[2]);
+
+    int numInvalid = (v[0] == 0) + (v[1] == 0) + (v[2] == 0) + (v[3] == 0);
+    switch(numInvalid){
+        case 0: return (v[1] + v[2] + 1) / 2;
+        case 1: return v[2];
+        case 2: return (v[2] + v[3] + 1) / 2;
+        default: return v[3];
+    }
+}
+
+static void halveDepthRow(const uint16_t * row0, const uint16_t * row1, size_t outWidth, DepthReduce reduce, uint16_t * dst){
+    for(size_t x = 0; x < outWidth; x++){
+        dst[x] = reduceDepth4(row0[x * 2], row0[x * 2 + 1], row1[x * 2], row1[x * 2 + 1], reduce);
+    }
+}
+
+void pyramidStrip(const uint16_t * src, size_t width, size_t numRows, DepthReduce reduce, uint16_t * half, uint16_t * quarter){
+    size_t halfWidth = width / 2;
+
+    for(size_t r = 0; r + 1 < numRows; r += 2){
+        halveDepthRow(src + r * width, src + (r + 1) * width, halfWidth, reduce, half + (r / 2) * halfWidth);
+    }
+    if( quarter && numRows >= 4 ){
+        halveDepthRow(half, half + halfWidth, halfWidth / 2, reduce, quarter);
+    }
+}
+
+void convertDepthY16(const uint16_t * src, size_t srcWidth, const RegionMap & region, float valueScale, uint16_t * dstMillimetres, float * dstMetres){
+    forEachRun(src, srcWidth, region, [&](const uint16_t * s, size_t n, size_t offset){
+        convertDepthY16(s, n, valueScale, dstMillimetres ? dstMillimetres + offset : nullptr, dstMetres ? dstMetres + offset : nullptr);
+    });
+}
+
+//256 entry RGB tables, built once
+typedef std::array<uint8_t, 256 * 3> ColormapLUT;
+
+static uint8_t toByte(float v){
+    return (uint8_t)std::min(std::max(v * 255.0f + 0.5f, 0.0f), 255.0f);
+}
+
+static const ColormapLUT & getJetLUT(){
+    static const ColormapLUT lut = []{
+        ColormapLUT t;
+        for(int i = 0; i < 256; i++){
+            float x = i / 255.0f;
+            t[i * 3 + 0] = toByte(1.5f - std::fabs(4.0f * x - 3.0f));
+            t[i * 3 + 1] = toByte(1.5f - std::fabs(4.0f * x - 2.0f));
+            t[i * 3 + 2] = toByte(1.5f - std::fabs(4.0f * x - 1.0f));
+        }
+        return t;
+    }();
+    return lut;
+}
+
+//polynomial fit of Google's Turbo colormap
+static const ColormapLUT & getTurboLUT(){
+    static const ColormapLUT lut = []{
+        ColormapLUT t;
+        for(int i = 0; i < 256; i++){
+            float x = i / 255.0f;
+            t[i * 3 + 0] = toByte(0.13572138f + x * (4.61539260f + x * (-42.66032258f + x * (132.13108234f + x * (-152.94239396f + x * 59.28637943f)))));
+            t[i * 3 + 1] = toByte(0.09140261f + x * (2.19418839f + x * (4.84296658f + x * (-14.18503333f + x * (4.27729857f + x * 2.82956604f)))));
+            t[i * 3 + 2] = toByte(0.10667330f + x * (12.64194608f + x * (-60.58204836f + x * (110.36276771f + x * (-89.90310912f + x * 27.34824973f)))));
+        }
+        return t;
+    }();
+    return lut;
+}
+
+// index = saturate(raw * a + b) - with bMaskInvalid raw 0 becomes invalidValue
+static void depthToIndex(const uint16_t * src, size_t n, float a, float b, bool bMaskInvalid, uint8_t invalidValue, uint8_t * dst){
+    size_t i = 0;
+
+#if defined(OFXORBBEC_AVX2)
+    {
+        const __m256 va = _mm256_set1_ps(a);
+        const __m256 vb = _mm256_set1_ps(b);
+        const __m256i zero = _mm256_setzero_si256();
+        const __m128i invalid = _mm_set1_epi8((char)invalidValue);
+        const __m128i maskOn = bMaskInvalid ? _mm_set1_epi8((char)0xFF) : _mm_setzero_si128();
+
+        for(; i + 16 <= n; i += 16){
+            __m256i raw = _mm256_loadu_si256((const __m256i *)(src + i));
+            __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(raw));
+            __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(raw, 1));
+            //mul + add rather than fmadd - AVX2 doesn't imply FMA, and it rounds the same as the SSE2 and scalar paths
+            __m256i ilo = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), va), vb));
+            __m256i ihi = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), va), vb));
+
+            //packs works per 128 bit lane so put the 64 bit chunks back in order
+            __m256i s16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(ilo, ihi), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i u8 = _mm_packus_epi16(_mm256_castsi256_si128(s16), _mm256_extracti128_si256(s16, 1));
+
+            __m256i inv16 = _mm256_cmpeq_epi16(raw, zero);
+            __m128i inv8 = _mm_and_si128(_mm_packs_epi16(_mm256_castsi256_si128(inv16), _mm256_extracti128_si256(inv16, 1)), maskOn);
+            u8 = _mm_or_si128(_mm_andnot_si128(inv8, u8), _mm_and_si128(inv8, invalid));
+
+            _mm_storeu_si128((__m128i *)(dst + i), u8);
+        }
+    }
+#endif
+
+#if defined(OFXORBBEC_SSE2)
+    {
+        const __m128 va = _mm_set1_ps(a);
+        const __m128 vb = _mm_set1_ps(b);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i invalid = _mm_set1_epi8((char)invalidValue);
+        const __m128i maskOn = bMaskInvalid ? _mm_set1_epi8((char)0xFF) : _mm_setzero_si128();
+
+        for(; i + 8 <= n; i += 8){
+            __m128i raw = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i ilo = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, zero)), va), vb));
+            __m128i ihi = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(raw, zero)), va), vb));
+            __m128i u8 = _mm_packus_epi16(_mm_packs_epi32(ilo, ihi), zero);
+
+            __m128i inv16 = _mm_cmpeq_epi16(raw, zero);
+            __m128i inv8 = _mm_and_si128(_mm_packs_epi16(inv16, zero), maskOn);
+            u8 = _mm_or_si128(_mm_andnot_si128(inv8, u8), _mm_and_si128(inv8, invalid));
+
+            _mm_storel_epi64((__m128i *)(dst + i), u8);
+        }
+    }
+#elif defined(OFXORBBEC_NEON)
+    {
+        const float32x4_t va = vdupq_n_f32(a);
+        //vcvtq truncates so add the rounding offset up front
+        const float32x4_t vb = vdupq_n_f32(b + 0.5f);
+        const uint16x8_t zero = vdupq_n_u16(0);
+        const uint8x8_t invalid = vdup_n_u8(invalidValue);
+        const uint8x8_t maskOn = vdup_n_u8(bMaskInvalid ? 0xFF : 0x00);
+
+        for(; i + 8 <= n; i += 8){
+            uint16x8_t raw = vld1q_u16(src + i);
+            float32x4_t flo = vmlaq_f32(vb, vcvtq_f32_u32(vmovl_u16(vget_low_u16(raw))), va);
+            float32x4_t fhi = vmlaq_f32(vb, vcvtq_f32_u32(vmovl_u16(vget_high_u16(raw))), va);
+            int16x8_t s16 = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(flo)), vqmovn_s32(vcvtq_s32_f32(fhi)));
+            uint8x8_t u8 = vqmovun_s16(s16);
+
+            uint8x8_t inv8 = vand_u8(vmovn_u16(vceqq_u16(raw, zero)), maskOn);
+            u8 = vbsl_u8(inv8, invalid, u8);
+
+            vst1_u8(dst + i, u8);
+        }
+    }
+#endif
+
+    for(; i < n; i++){
+        if( bMaskInvalid && src[i] == 0 ){
+            dst[i] = invalidValue;
+        }else{
+            float v = src[i] * a + b;
+            dst[i] = (uint8_t)std::min(std::max(std::floor(v + 0.5f), 0.0f), 255.0f);
+        }
+    }
+}
+
+void depthToPreview(const uint16_t * src, size_t numPixels, float valueScale, float nearMM, float farMM, DepthColormap colormap, const uint8_t invalidColor[3], uint8_t * dst){
+    //index = (raw * valueScale - near) / (far - near) * 255
+    float range = std::max(farMM - nearMM, 1.0f);
+    float a = valueScale * 255.0f / range;
+    float b = -nearMM * 255.0f / range;
+    if( colormap == DEPTH_COLORMAP_NEAR_BRIGHT ){
+        a = -a;
+        b = 255.0f - b;
+    }
+
+    if( getNumChannels(colormap) == 1 ){
+        depthToIndex(src, numPixels, a, b, true, invalidColor[0], dst);
+        return;
+    }
+
+    //colormaps - index a block into L1 then expand it through the table while it's still hot
+    const ColormapLUT & lut = colormap == DEPTH_COLORMAP_TURBO ? getTurboLUT() : getJetLUT();
+    const size_t blockSize = 1024;
+    uint8_t index[blockSize];
+
+    for(size_t start = 0; start < numPixels; start += blockSize){
+        size_t n = std::min(blockSize, numPixels - start);
+        const uint16_t * s = src + start;
+        uint8_t * d = dst + start * 3;
+
+        depthToIndex(s, n, a, b, false, 0, index);
+        for(size_t i = 0; i < n; i++){
+            const uint8_t * c = s[i] ? &lut[index[i] * 3] : invalidColor;
+            d[0] = c[0];
+            d[1] = c[1];
+            d[2] = c[2];
+            d += 3;
+        }
+    }
+}
+
+void depthToPreview(const uint16_t * src, size_t srcWidth, const RegionMap & region, float valueScale, float nearMM, float farMM, DepthColormap colormap, const uint8_t invalidColor[3], uint8_t * dst){
+    size_t channels = getNumChannels(colormap);
+    forEachRun(src, srcWidth, region, [&](const uint16_t * s, size_t n, size_t offset){
+        depthToPreview(s, n, valueScale, nearMM, farMM, colormap, invalidColor, dst + offset * channels);
+    });
+}
+
+static const size_t kAutoGainBins = 1024;
+
+static void accumulateHistogram(const uint16_t * src, size_t n, int shift, uint32_t * hist){
+    //4 interleaved histograms so runs of equal values don't stall on the same counter
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4){
+        hist[std::min((size_t)(src[i + 0] >> shift), kAutoGainBins - 1) * 4 + 0]++;
+        hist[std::min((size_t)(src[i + 1] >> shift), kAutoGainBins - 1) * 4 + 1]++;
+        hist[std::min((size_t)(src[i + 2] >> shift), kAutoGainBins - 1) * 4 + 2]++;
+        hist[std::min((size_t)(src[i + 3] >> shift), kAutoGainBins - 1) * 4 + 3]++;
+    }
+    for(; i < n; i++){
+        hist[std::min((size_t)(src[i] >> shift), kAutoGainBins - 1) * 4]++;
+    }
+}
+
+static void updateAutoGain(AutoGainState & state, size_t numPixels){
+    const uint32_t * hist = state.histogram.data();
+    uint64_t lowCount = (uint64_t)(numPixels * std::min(std::max(state.lowPercentile, 0.0f), 100.0f) / 100.0f);
+    uint64_t highCount = (uint64_t)(numPixels * std::min(std::max(state.highPercentile, 0.0f), 100.0f) / 100.0f);
+
+    size_t lowBin = 0, highBin = kAutoGainBins - 1, topBin = 0;
+    uint64_t sum = 0;
+    bool bLow = false, bHigh = false;
+    for(size_t b = 0; b < kAutoGainBins; b++){
+        uint32_t count = hist[b * 4] + hist[b * 4 + 1] + hist[b * 4 + 2] + hist[b * 4 + 3];
+        if( count ){
+            topBin = b;
+        }
+        sum += count;
+        if( !bLow && sum > lowCount ){
+            lowBin = b;
+            bLow = true;
+        }
+        if( !bHigh && sum >= highCount ){
+            highBin = b;
+            bHigh = true;
+        }
+    }
+
+    state.low = (uint16_t)(lowBin << state.shift);
+    state.high = (uint16_t)std::min(((highBin + 1) << state.shift) - 1, (size_t)65535);
+    state.bValid = true;
+
+    //keep the bins spread over the values the sensor really produces
+    if( topBin == kAutoGainBins - 1 && state.shift < 6 ){
+        state.shift++;
+    }else if( topBin < kAutoGainBins / 4 && state.shift > 0 ){
+        state.shift--;
+    }
+}
+
+void irToPreview(const uint16_t * src, size_t numPixels, AutoGainState & state, uint8_t * dst){
+    RegionMap all;
+    all.outWidth = numPixels;
+    all.outHeight = 1;
+    irToPreview(src, numPixels, all, state, dst);
+}
+
+void irToPreview(const uint16_t * src, size_t srcWidth, const RegionMap & region, AutoGainState & state, uint8_t * dst){
+    size_t numPixels = region.outWidth * region.outHeight;
+    state.histogram.assign(kAutoGainBins * 4, 0);
+
+    //nothing to go on for the first frame - histogram it first
+    if( !state.bValid ){
+        forEachRun(src, srcWidth, region, [&](const uint16_t * s, size_t n, size_t){
+            accumulateHistogram(s, n, state.shift, state.histogram.data());
+        });
+        updateAutoGain(state, numPixels);
+        state.histogram.assign(kAutoGainBins * 4, 0);
+    }
+
+    float range = std::max((float)state.high - (float)state.low, 1.0f);
+    float a = 255.0f / range;
+    float b = -(float)state.low * a;
+    int shift = state.shift;
+
+    //map a block with the SIMD kernel then histogram it while it's still in L1
+    const size_t blockSize = 4096;
+    forEachRun(src, srcWidth, region, [&](const uint16_t * s, size_t count, size_t offset){
+        for(size_t start = 0; start < count; start += blockSize){
+            size_t n = std::min(blockSize, count - start);
+            depthToIndex(s + start, n, a, b, false, 0, dst + offset + start);
+            accumulateHistogram(s + start, n, shift, state.histogram.data());
+        }
+    });
+
+    updateAutoGain(state, numPixels);
+}
+
+//BT.601 limited range in 6 bit fixed point - small enough that every term fits in 16 bit lanes
+static const int kY = 75;   //1.164
+static const int kRV = 102; //1.596
+static const int kGU = 25;  //0.391
+static const int kGV = 52;  //0.813
+static const int kBU = 129; //2.018
+
+static inline uint8_t clampByte(int v){
+    return (uint8_t)std::min(std::max(v, 0), 255);
+}
+
+static inline void yuvToPixel(int y, int u, int v, PixelLayout layout, uint8_t * d){
+    int yy = (y - 16) * kY + 32;
+    u -= 128;
+    v -= 128;
+    uint8_t r = clampByte((yy + kRV * v) >> 6);
+    uint8_t g = clampByte((yy - kGU * u - kGV * v) >> 6);
+    uint8_t b = clampByte((yy + kBU * u) >> 6);
+    if( layout == LAYOUT_BGR ){
+        std::swap(r, b);
+    }
+    d[0] = r;
+    d[1] = g;
+    d[2] = b;
+    if( layout == LAYOUT_RGBA ){
+        d[3] = 255;
+    }
+}
+
+#if defined(OFXORBBEC_SSE2)
+
+// y0 / y1 are the even / odd pixels of a block of 16 and u / v the 8 chroma samples they share, all as 16 bit lanes.
+// Returns 16 bytes per channel in pixel order.
+static inline void yuvToRGB16(__m128i y0, __m128i y1, __m128i u, __m128i v, __m128i & r, __m128i & g, __m128i & b){
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i c16 = _mm_set1_epi16(16);
+    const __m128i round = _mm_set1_epi16(32);
+
+    u = _mm_sub_epi16(u, c128);
+    v = _mm_sub_epi16(v, c128);
+    __m128i rv = _mm_mullo_epi16(v, _mm_set1_epi16(kRV));
+    __m128i guv = _mm_add_epi16(_mm_mullo_epi16(u, _mm_set1_epi16(kGU)), _mm_mullo_epi16(v, _mm_set1_epi16(kGV)));
+    __m128i bu = _mm_mullo_epi16(u, _mm_set1_epi16(kBU));
+
+    y0 = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(y0, c16), _mm_set1_epi16(kY)), round);
+    y1 = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(y1, c16), _mm_set1_epi16(kY)), round);
+
+    //saturating adds - anything that clips here is out of 0 - 255 anyway
+    __m128i r0 = _mm_srai_epi16(_mm_adds_epi16(y0, rv), 6);
+    __m128i r1 = _mm_srai_epi16(_mm_adds_epi16(y1, rv), 6);
+    __m128i g0 = _mm_srai_epi16(_mm_subs_epi16(y0, guv), 6);
+    __m128i g1 = _mm_srai_epi16(_mm_subs_epi16(y1, guv), 6);
+    __m128i b0 = _mm_srai_epi16(_mm_adds_epi16(y0, bu), 6);
+    __m128i b1 = _mm_srai_epi16(_mm_adds_epi16(y1, bu), 6);
+
+    //zip even and odd back together
+    r = _mm_unpacklo_epi8(_mm_packus_epi16(r0, r0), _mm_packus_epi16(r1, r1));
+    g = _mm_unpacklo_epi8(_mm_packus_epi16(g0, g0), _mm_packus_epi16(g1, g1));
+    b = _mm_unpacklo_epi8(_mm_packus_epi16(b0, b0), _mm_packus_epi16(b1, b1));
+}
+
+// splits the 16 bit lanes of a:b into even and odd lanes - values must be positive and fit in 15 bits
+static inline void deinterleave16(__m128i a, __m128i b, __m128i & even, __m128i & odd){
+    even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    odd = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+}
+
+#if defined(OFXORBBEC_SSSE3)
+//pshufb masks that spread 16 pixels of one channel over the 3 output registers of packed RGB
+struct InterleaveMasks{
+    __m128i m[3][3]; //[output register][channel]
+};
+
+static const InterleaveMasks & getInterleaveMasks(){
+    static const InterleaveMasks masks = []{
+        InterleaveMasks t;
+        for(int reg = 0; reg < 3; reg++){
+            for(int ch = 0; ch < 3; ch++){
+                alignas(16) int8_t bytes[16];
+                for(int k = 0; k < 16; k++){
+                    int j = reg * 16 + k;
+                    bytes[k] = j % 3 == ch ? (int8_t)(j / 3) : (int8_t)0x80;
+                }
+                t.m[reg][ch] = _mm_load_si128((const __m128i *)bytes);
+            }
+        }
+        return t;
+    }();
+    return masks;
+}
+#endif
+
+static inline void storePixels16(__m128i r, __m128i g, __m128i b, PixelLayout layout, uint8_t * d){
+    if( layout == LAYOUT_RGBA ){
+        const __m128i a = _mm_set1_epi8((char)0xFF);
+        __m128i rgLo = _mm_unpacklo_epi8(r, g);
+        __m128i rgHi = _mm_unpackhi_epi8(r, g);
+        __m128i baLo = _mm_unpacklo_epi8(b, a);
+        __m128i baHi = _mm_unpackhi_epi8(b, a);
+        _mm_storeu_si128((__m128i *)(d + 0), _mm_unpacklo_epi16(rgLo, baLo));
+        _mm_storeu_si128((__m128i *)(d + 16), _mm_unpackhi_epi16(rgLo, baLo));
+        _mm_storeu_si128((__m128i *)(d + 32), _mm_unpacklo_epi16(rgHi, baHi));
+        _mm_storeu_si128((__m128i *)(d + 48), _mm_unpackhi_epi16(rgHi, baHi));
+        return;
+    }
+    if( layout == LAYOUT_BGR ){
+        std::swap(r, b);
+    }
+#if defined(OFXORBBEC_SSSE3)
+    const InterleaveMasks & masks = getInterleaveMasks();
+    for(int reg = 0; reg < 3; reg++){
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, masks.m[reg][0]), _mm_shuffle_epi8(g, masks.m[reg][1])), _mm_shuffle_epi8(b, masks.m[reg][2]));
+        _mm_storeu_si128((__m128i *)(d + reg * 16), out);
+    }
+#else
+    //no byte shuffle in plain SSE2 - the math is still vectorised, the 3 channel interleave isn't
+    alignas(16) uint8_t tr[16], tg[16], tb[16];
+    _mm_store_si128((__m128i *)tr, r);
+    _mm_store_si128((__m128i *)tg, g);
+    _mm_store_si128((__m128i *)tb, b);
+    for(int i = 0; i < 16; i++){
+        d[0] = tr[i];
+        d[1] = tg[i];
+        d[2] = tb[i];
+        d += 3;
+    }
+#endif
+}
+
+#elif defined(OFXORBBEC_NEON)
+
+static inline void yuvToRGB16(int16x8_t y0, int16x8_t y1, int16x8_t u, int16x8_t v, uint8x16_t & r, uint8x16_t & g, uint8x16_t & b){
+    u = vsubq_s16(u, vdupq_n_s16(128));
+    v = vsubq_s16(v, vdupq_n_s16(128));
+    int16x8_t rv = vmulq_n_s16(v, kRV);
+    int16x8_t guv = vmlaq_n_s16(vmulq_n_s16(u, kGU), v, kGV);
+    int16x8_t bu = vmulq_n_s16(u, kBU);
+
+    const int16x8_t round = vdupq_n_s16(32);
+    y0 = vmlaq_n_s16(round, vsubq_s16(y0, vdupq_n_s16(16)), kY);
+    y1 = vmlaq_n_s16(round, vsubq_s16(y1, vdupq_n_s16(16)), kY);
+
+    uint8x8x2_t rz = vzip_u8(vqmovun_s16(vshrq_n_s16(vqaddq_s16(y0, rv), 6)), vqmovun_s16(vshrq_n_s16(vqaddq_s16(y1, rv), 6)));
+    uint8x8x2_t gz = vzip_u8(vqmovun_s16(vshrq_n_s16(vqsubq_s16(y0, guv), 6)), vqmovun_s16(vshrq_n_s16(vqsubq_s16(y1, guv), 6)));
+    uint8x8x2_t bz = vzip_u8(vqmovun_s16(vshrq_n_s16(vqaddq_s16(y0, bu), 6)), vqmovun_s16(vshrq_n_s16(vqaddq_s16(y1, bu), 6)));
+    r = vcombine_u8(rz.val[0], rz.val[1]);
+    g = vcombine_u8(gz.val[0], gz.val[1]);
+    b = vcombine_u8(bz.val[0], bz.val[1]);
+}
+
+static inline int16x8_t widen(uint8x8_t v){
+    return vreinterpretq_s16_u16(vmovl_u8(v));
+}
+
+static inline void storePixels16(uint8x16_t r, uint8x16_t g, uint8x16_t b, PixelLayout layout, uint8_t * d){
+    if( layout == LAYOUT_RGBA ){
+        uint8x16x4_t px = {{r, g, b, vdupq_n_u8(255)}};
+        vst4q_u8(d, px);
+    }else if( layout == LAYOUT_BGR ){
+        uint8x16x3_t px = {{b, g, r}};
+        vst3q_u8(d, px);
+    }else{
+        uint8x16x3_t px = {{r, g, b}};
+        vst3q_u8(d, px);
+    }
+}
+
+#endif
+
+// one row of NV21 / NV12 - uv points at the interleaved chroma row shared by this row pair
+static void semiPlanarRow(const uint8_t * y, const uint8_t * uv, bool bVU, size_t width, PixelLayout layout, uint8_t * d){
+    size_t channels = getNumChannels(layout);
+    size_t i = 0;
+
+#if defined(OFXORBBEC_SSE2)
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    for(; i + 16 <= width; i += 16){
+        __m128i yy = _mm_loadu_si128((const __m128i *)(y + i));
+        __m128i cc = _mm_loadu_si128((const __m128i *)(uv + i));
+        __m128i first = _mm_and_si128(cc, lowBytes);
+        __m128i second = _mm_srli_epi16(cc, 8);
+
+        __m128i r, g, b;
+        yuvToRGB16(_mm_and_si128(yy, lowBytes), _mm_srli_epi16(yy, 8), bVU ? second : first, bVU ? first : second, r, g, b);
+        storePixels16(r, g, b, layout, d + i * channels);
+    }
+#elif defined(OFXORBBEC_NEON)
+    for(; i + 16 <= width; i += 16){
+        uint8x8x2_t yy = vld2_u8(y + i);
+        uint8x8x2_t cc = vld2_u8(uv + i);
+
+        uint8x16_t r, g, b;
+        yuvToRGB16(widen(yy.val[0]), widen(yy.val[1]), widen(cc.val[bVU ? 1 : 0]), widen(cc.val[bVU ? 0 : 1]), r, g, b);
+        storePixels16(r, g, b, layout, d + i * channels);
+    }
+#endif
+
+    for(; i < width; i += 2){
+        int u = uv[i + (bVU ? 1 : 0)];
+        int v = uv[i + (bVU ? 0 : 1)];
+        yuvToPixel(y[i], u, v, layout, d + i * channels);
+        if( i + 1 < width ){
+            yuvToPixel(y[i + 1], u, v, layout, d + (i + 1) * channels);
+        }
+    }
+}
+
+// one row of packed 4:2:2 - YUYV is Y0 U Y1 V, UYVY is U Y0 V Y1
+static void packedRow(const uint8_t * src, bool bUYVY, size_t width, PixelLayout layout, uint8_t * d){
+    size_t channels = getNumChannels(layout);
+    size_t i = 0;
+
+#if defined(OFXORBBEC_SSE2)
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    for(; i + 16 <= width; i += 16){
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        __m128i b16 = _mm_loadu_si128((const __m128i *)(src + i * 2 + 16));
+
+        //luma / chroma of pixels 0 - 7 and 8 - 15 as 16 bit lanes
+        __m128i lumaA = bUYVY ? _mm_srli_epi16(a, 8) : _mm_and_si128(a, lowBytes);
+        __m128i lumaB = bUYVY ? _mm_srli_epi16(b16, 8) : _mm_and_si128(b16, lowBytes);
+        __m128i chromaA = bUYVY ? _mm_and_si128(a, lowBytes) : _mm_srli_epi16(a, 8);
+        __m128i chromaB = bUYVY ? _mm_and_si128(b16, lowBytes) : _mm_srli_epi16(b16, 8);
+
+        __m128i y0, y1, u, v;
+        deinterleave16(lumaA, lumaB, y0, y1);
+        deinterleave16(chromaA, chromaB, u, v);
+
+        __m128i r, g, b;
+        yuvToRGB16(y0, y1, u, v, r, g, b);
+        storePixels16(r, g, b, layout, d + i * channels);
+    }
+#elif defined(OFXORBBEC_NEON)
+    for(; i + 16 <= width; i += 16){
+        uint8x8x4_t px = vld4_u8(src + i * 2);
+
+        uint8x16_t r, g, b;
+        if( bUYVY ){
+            yuvToRGB16(widen(px.val[1]), widen(px.val[3]), widen(px.val[0]), widen(px.val[2]), r, g, b);
+        }else{
+            yuvToRGB16(widen(px.val[0]), widen(px.val[2]), widen(px.val[1]), widen(px.val[3]), r, g, b);
+        }
+        storePixels16(r, g, b, layout, d + i * channels);
+    }
+#endif
+
+    for(; i + 1 < width; i += 2){
+        const uint8_t * s = src + i * 2;
+        int y0 = bUYVY ? s[1] : s[0];
+        int y1 = bUYVY ? s[3] : s[2];
+        int u = bUYVY ? s[0] : s[1];
+        int v = bUYVY ? s[2] : s[3];
+        yuvToPixel(y0, u, v, layout, d + i * channels);
+        yuvToPixel(y1, u, v, layout, d + (i + 1) * channels);
+    }
+    //odd width region - the last pixel is the first half of a pair, whose chroma is still in the source row
+    if( i < width ){
+        const uint8_t * s = src + i * 2;
+        yuvToPixel(bUYVY ? s[1] : s[0], bUYVY ? s[0] : s[1], bUYVY ? s[2] : s[3], layout, d + i * channels);
+    }
+}
+
+void yuvToRGB(YUVFormat format, const uint8_t * src, size_t width, size_t height, const RegionMap & region, size_t rowStart, size_t rowEnd, PixelLayout layout, uint8_t * dst){
+    size_t channels = getNumChannels(layout);
+    rowEnd = std::min(rowEnd, region.outHeight);
+    bool bSemiPlanar = format == YUV_NV21 || format == YUV_NV12;
+
+    for(size_t row = rowStart; row < rowEnd; row++){
+        size_t sy = region.y + row * region.step;
+        uint8_t * d = dst + row * region.outWidth * channels;
+        const uint8_t * uv = src + width * height + (sy / 2) * width;
+
+        //full resolution rows still go through the SIMD row kernels
+        if( region.step == 1 ){
+            if( bSemiPlanar ){
+                semiPlanarRow(src + sy * width + region.x, uv + region.x, format == YUV_NV21, region.outWidth, layout, d);
+            }else{
+                packedRow(src + (sy * width + region.x) * 2, format == YUV_UYVY, region.outWidth, layout, d);
+            }
+            continue;
+        }
+
+        //decimated - only read the pixels we keep
+        for(size_t c = 0; c < region.outWidth; c++){
+            size_t sx = region.x + c * region.step;
+            size_t pair = sx & ~(size_t)1;
+            int y, u, v;
+            if( bSemiPlanar ){
+                y = src[sy * width + sx];
+                u = uv[pair + (format == YUV_NV21 ? 1 : 0)];
+                v = uv[pair + (format == YUV_NV21 ? 0 : 1)];
+            }else{
+                const uint8_t * p = src + (sy * width + pair) * 2;
+                bool bUYVY = format == YUV_UYVY;
+                y = bUYVY ? p[(sx & 1) ? 3 : 1] : p[(sx & 1) ? 2 : 0];
+                u = bUYVY ? p[0] : p[1];
+                v = bUYVY ? p[2] : p[3];
+            }
+            yuvToPixel(y, u, v, layout, d + c * channels);
+        }
+    }
+}
+
+void yuvToRGB(YUVFormat format, const uint8_t * src, size_t width, size_t height, size_t rowStart, size_t rowEnd, PixelLayout layout, uint8_t * dst){
+    RegionMap all;
+    all.outWidth = width;
+    all.outHeight = height;
+    yuvToRGB(format, src, width, height, all, rowStart, rowEnd, layout, dst);
+}
+
+};
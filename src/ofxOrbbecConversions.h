@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ofxOrbbec{
+
+enum DepthColormap{
+    DEPTH_COLORMAP_GREY,        //1 channel - far is bright
+    DEPTH_COLORMAP_NEAR_BRIGHT, //1 channel - near is bright
+    DEPTH_COLORMAP_JET,         //3 channel RGB
+    DEPTH_COLORMAP_TURBO        //3 channel RGB
+};
+
+enum PixelLayout{
+    LAYOUT_RGB,
+    LAYOUT_BGR,
+    LAYOUT_RGBA
+};
+
+enum YUVFormat{
+    YUV_NV21,   //Y plane then interleaved VU at half resolution
+    YUV_NV12,   //Y plane then interleaved UV at half resolution
+    YUV_YUYV,   //packed 4:2:2 - same as YUY2
+    YUV_UYVY    //packed 4:2:2
+};
+
+// How 2x2 depth blocks are reduced for the pyramid - pixels with no depth ( 0 ) are left out of every policy
+enum DepthReduce{
+    DEPTH_REDUCE_MIN,       //nearest - keeps thin foreground objects
+    DEPTH_REDUCE_MEDIAN,    //drops single pixel noise
+    DEPTH_REDUCE_MEAN       //smoothest
+};
+
+// Part of a frame to read, in source pixels, taking every decimation-th column and row.
+// A width / height of 0 runs to the edge of the frame.
+struct Region{
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    int decimation = 1;
+};
+
+// A Region clipped to one frame size plus the size of the output it produces
+struct RegionMap{
+    size_t x = 0;
+    size_t y = 0;
+    size_t step = 1;
+    size_t outWidth = 0;
+    size_t outHeight = 0;
+
+    //true when the output is the whole source frame as is
+    bool isFull(size_t srcWidth, size_t srcHeight) const;
+};
+
+// alignX rounds x down so chroma pairs of 4:2:x YUV stay together
+RegionMap mapRegion(const Region & region, size_t srcWidth, size_t srcHeight, size_t alignX = 1);
+
+// Region of a single channel frame copied as is - Y8 / Y16 IR
+void copyRegion(const uint8_t * src, size_t srcWidth, const RegionMap & region, uint8_t * dst);
+void copyRegion(const uint16_t * src, size_t srcWidth, const RegionMap & region, uint16_t * dst);
+
+// Region of an RGB888 frame in the requested layout
+void rgbToLayout(const uint8_t * src, size_t srcWidth, const RegionMap & region, PixelLayout layout, uint8_t * dst);
+
+// 2x2 reduction of a strip of up to 4 rows into the 1/2 level ( width / 2 wide ), then of those rows into the 1/4 level.
+// Call it on the rows a conversion just wrote, 4 at a time, so they are still in cache. A strip of 2 or 3 rows only adds to the 1/2 level.
+// quarter can be null. Color is averaged, depth uses reduce.
+void pyramidStrip(const uint8_t * src, size_t width, size_t numRows, size_t channels, uint8_t * half, uint8_t * quarter);
+void pyramidStrip(const uint16_t * src, size_t width, size_t numRows, DepthReduce reduce, uint16_t * half, uint16_t * quarter);
+
+// Percentile auto gain for 16-bit IR. The range used for a frame comes from the previous frame's histogram
+// so the mapping and the histogram for the next frame happen in the same pass.
+struct AutoGainState{
+    float lowPercentile = 1.0f;     //this percent of pixels or less map to 0
+    float highPercentile = 99.5f;   //above this map to 255 - keep it high for bright retro-reflective markers
+
+    //internal
+    uint16_t low = 0;
+    uint16_t high = 65535;
+    int shift = 6;                  //histogram bin = value >> shift, adapts to the range the sensor actually uses
+    bool bValid = false;
+    std::vector <uint32_t> histogram;
+};
+
+size_t getNumChannels(DepthColormap colormap);
+size_t getNumChannels(PixelLayout layout);
+
+// Y16 depth to millimetres and / or metres in a single pass.
+// valueScale is ob::DepthFrame::getValueScale() ( raw units to mm ), either output can be nullptr. Metres are NaN where there is no depth.
+void convertDepthY16(const uint16_t * src, size_t numPixels, float valueScale, uint16_t * dstMillimetres, float * dstMetres);
+void convertDepthY16(const uint16_t * src, size_t srcWidth, const RegionMap & region, float valueScale, uint16_t * dstMillimetres, float * dstMetres);
+
+// Y16 depth to an 8-bit preview in one pass - nearMM maps to the start of the colormap and farMM to the end.
+// Pixels with no depth ( 0 ) get invalidColor. dst needs numPixels * getNumChannels(colormap) bytes.
+void depthToPreview(const uint16_t * src, size_t numPixels, float valueScale, float nearMM, float farMM, DepthColormap colormap, const uint8_t invalidColor[3], uint8_t * dst);
+void depthToPreview(const uint16_t * src, size_t srcWidth, const RegionMap & region, float valueScale, float nearMM, float farMM, DepthColormap colormap, const uint8_t invalidColor[3], uint8_t * dst);
+
+// Y16 IR to 8-bit, stretching state.low - state.high over 0 - 255 and updating state for the next frame.
+void irToPreview(const uint16_t * src, size_t numPixels, AutoGainState & state, uint8_t * dst);
+void irToPreview(const uint16_t * src, size_t srcWidth, const RegionMap & region, AutoGainState & state, uint8_t * dst);
+
+// BT.601 limited range YUV to 8-bit RGB / BGR / RGBA written straight into dst ( width * height * channels, tightly packed ).
+// Only rows [rowStart, rowEnd) are converted so a frame can be split into row bands across threads.
+void yuvToRGB(YUVFormat format, const uint8_t * src, size_t width, size_t height, size_t rowStart, size_t rowEnd, PixelLayout layout, uint8_t * dst);
+// Same for a region - rowStart / rowEnd are output rows and dst is outWidth * outHeight. Map the region with alignX 2.
+void yuvToRGB(YUVFormat format, const uint8_t * src, size_t width, size_t height, const RegionMap & region, size_t rowStart, size_t rowEnd, PixelLayout layout, uint8_t * dst);
+
+};
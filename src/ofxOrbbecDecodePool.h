@@ -0,0 +1,204 @@
+#pragma once
+
+#include "ofxOrbbecStreamWorker.h"
+
+namespace ofxOrbbec{
+
+struct DecodeWorkerStats{
+    ThreadStats thread;
+    uint64_t numDecoded = 0;
+    float avgDecodeMs = 0.0;    //time spent in the decode callback per frame
+    float decodeFps = 0.0;      //frames this worker decoded per second since it started
+};
+
+// N threads decoding consecutive jobs in parallel from one bounded queue.
+// Finished jobs go through a reorder ring so deliver is called one at a time in the order jobs were pushed.
+template <typename Job>
+class DecodePool{
+    public:
+        typedef std::function<void(Job &, size_t)> DecodeCallback;  //job, worker index - runs in parallel
+        typedef std::function<void(Job &)> DeliverCallback;         //runs in push order
+
+        ~DecodePool(){
+            stop();
+        }
+
+        void start(const std::string & name, size_t numWorkers, size_t queueSize, DropPolicy policy, const ThreadSettings & threadSettings, DecodeCallback decode, DeliverCallback deliver){
+            stop();
+            numWorkers = std::max((size_t)1, numWorkers);
+            mQueue.assign(std::max((size_t)1, queueSize), Job());
+            //a worker can finish ahead of the ones before it, bound how far
+            mReorder.assign(numWorkers * 2, Slot());
+            mPolicy = policy;
+            mDecode = decode;
+            mDeliver = deliver;
+            mNextSeq = mDeliverSeq = 0;
+            mNumDropped = 0;
+            bRunning = true;
+
+            mWorkers.clear();
+            for(size_t i = 0; i < numWorkers; i++){
+                mWorkers.push_back(std::make_unique<Worker>());
+                auto & worker = *mWorkers.back();
+                worker.pool = this;
+                worker.index = i;
+                worker.name = name + " " + ofToString(i);
+                worker.threadSettings = threadSettings;
+                worker.startThread();
+            }
+        }
+
+        void stop(){
+            bRunning = false;
+            mQueueCondition.notify_all();
+            for(auto & worker : mWorkers){
+                worker->waitForThread(true, 2000);
+            }
+            mWorkers.clear();
+
+            std::unique_lock<std::mutex> lck(mQueueMutex);
+            for(auto & job : mQueue){
+                job = Job();
+            }
+            mHead = mCount = 0;
+            std::unique_lock<std::mutex> reorderLck(mReorderMutex);
+            for(auto & slot : mReorder){
+                slot = Slot();
+            }
+        }
+
+        bool isRunning() const{
+            return bRunning;
+        }
+
+        //called from the capture thread - never blocks
+        void push(const Job & job){
+            {
+                std::unique_lock<std::mutex> lck(mQueueMutex);
+                if( mQueue.empty() ){
+                    return;
+                }
+                if( mCount == mQueue.size() ){
+                    mNumDropped++;
+                    if( mPolicy == DROP_NEWEST ){
+                        return;
+                    }
+                    mQueue[mHead] = Job();
+                    mHead = (mHead + 1) % mQueue.size();
+                    mCount--;
+                }
+                mQueue[(mHead + mCount) % mQueue.size()] = job;
+                mCount++;
+            }
+            mQueueCondition.notify_one();
+        }
+
+        uint64_t getNumDropped() const{
+            return mNumDropped;
+        }
+
+        std::vector <DecodeWorkerStats> getWorkerStats() const{
+            std::vector <DecodeWorkerStats> stats;
+            for(auto & worker : mWorkers){
+                DecodeWorkerStats s;
+                s.thread = worker->threadHandle.getStats();
+                s.numDecoded = worker->numDecoded;
+                if( s.numDecoded ){
+                    s.avgDecodeMs = worker->decodeTimeUs / 1000.0 / s.numDecoded;
+                }
+                if( s.thread.wallTimeMs > 0.0 ){
+                    s.decodeFps = s.numDecoded * 1000.0 / s.thread.wallTimeMs;
+                }
+                stats.push_back(s);
+            }
+            return stats;
+        }
+
+    protected:
+        struct Slot{
+            Job job;
+            bool bDone = false;
+        };
+
+        class Worker : public ofThread{
+            public:
+                void threadedFunction() override{
+                    threadHandle.setup(name, threadSettings);
+                    pool->run(*this);
+                }
+
+                DecodePool * pool = nullptr;
+                size_t index = 0;
+                std::string name;
+                ThreadSettings threadSettings;
+                ThreadHandle threadHandle;
+                std::atomic <uint64_t> numDecoded {0};
+                std::atomic <uint64_t> decodeTimeUs {0};
+        };
+
+        void run(Worker & worker){
+            while( bRunning ){
+                Job job;
+                uint64_t seq = 0;
+                {
+                    std::unique_lock<std::mutex> lck(mQueueMutex);
+                    //taking the job and its sequence number together keeps them in push order
+                    mQueueCondition.wait_for(lck, std::chrono::milliseconds(20), [this]{
+                        return !bRunning || ( mCount > 0 && mNextSeq - mDeliverSeq < mReorder.size() );
+                    });
+                    if( !bRunning || mCount == 0 || mNextSeq - mDeliverSeq >= mReorder.size() ){
+                        continue;
+                    }
+                    job = std::move(mQueue[mHead]);
+                    mQueue[mHead] = Job();
+                    mHead = (mHead + 1) % mQueue.size();
+                    mCount--;
+                    seq = mNextSeq++;
+                }
+
+                uint64_t startUs = ofGetElapsedTimeMicros();
+                mDecode(job, worker.index);
+                worker.decodeTimeUs += ofGetElapsedTimeMicros() - startUs;
+                worker.numDecoded++;
+
+                {
+                    std::unique_lock<std::mutex> lck(mReorderMutex);
+                    auto & slot = mReorder[seq % mReorder.size()];
+                    slot.job = std::move(job);
+                    slot.bDone = true;
+
+                    //whoever completes the oldest outstanding job delivers everything that is ready behind it
+                    while( true ){
+                        auto & next = mReorder[mDeliverSeq % mReorder.size()];
+                        if( !next.bDone ){
+                            break;
+                        }
+                        mDeliver(next.job);
+                        next = Slot();
+                        mDeliverSeq++;
+                    }
+                }
+                mQueueCondition.notify_all();
+            }
+        }
+
+        DropPolicy mPolicy = DROP_OLDEST;
+        DecodeCallback mDecode;
+        DeliverCallback mDeliver;
+        std::vector <std::unique_ptr<Worker>> mWorkers;
+        std::atomic <bool> bRunning {false};
+
+        std::mutex mQueueMutex;
+        std::condition_variable mQueueCondition;
+        std::vector <Job> mQueue;
+        size_t mHead = 0;
+        size_t mCount = 0;
+        uint64_t mNextSeq = 0;
+
+        std::mutex mReorderMutex;
+        std::vector <Slot> mReorder;
+        std::atomic <uint64_t> mDeliverSeq {0};
+        std::atomic <uint64_t> mNumDropped {0};
+};
+
+};
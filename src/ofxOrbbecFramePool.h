@@ -0,0 +1,102 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+namespace ofxOrbbec{
+
+// A processed frame plus the metadata of the ob::Frame it came from.
+template <typename T>
+struct FrameData{
+    T data;
+    uint64_t index = 0;             //ob::Frame::index()
+    uint64_t timeStampUs = 0;       //device timestamp
+    uint64_t systemTimeStampUs = 0; //host timestamp when the SDK received the frame
+    uint64_t decodeLatencyUs = 0;   //H.264 / H.265 color - packet queued for decode to picture out
+    std::shared_ptr<void> source;   //set when data points at memory it doesn't own ( ie: an SDK frame ) - keeps it alive
+};
+
+// Read only lease on a pooled frame. Hold it as long as you need to read in place,
+// the buffer goes back to its pool once the last FrameRef to it is released.
+template <typename T>
+using FrameRef = std::shared_ptr<const FrameData<T>>;
+
+// Fixed set of reusable frame buffers.
+// A buffer is free when the pool holds the only reference to it, so handing out
+// and releasing leases never allocates once the pool has grown to its working size.
+template <typename T>
+class FramePool{
+    public:
+
+        //producer side - returns a buffer nobody else is reading
+        std::shared_ptr<FrameData<T>> acquire(){
+            std::unique_lock<std::mutex> lck(mMutex);
+            if( mRelease ){
+                for(auto & b : mBuffers){
+                    if( b.use_count() == 1 ){
+                        std::atomic_thread_fence(std::memory_order_acquire);
+                        mRelease(*b);
+                    }
+                }
+            }
+            for(size_t i = 0; i < mBuffers.size(); i++){
+                size_t idx = (mNext + i) % mBuffers.size();
+                if( mBuffers[idx].use_count() == 1 ){
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    mNext = (idx + 1) % mBuffers.size();
+                    return mBuffers[idx];
+                }
+            }
+            //every buffer is leased - grow
+            mBuffers.push_back(std::make_shared<FrameData<T>>());
+            return mBuffers.back();
+        }
+
+        //grow the pool up front so steady state never has to
+        void reserve(size_t num){
+            std::unique_lock<std::mutex> lck(mMutex);
+            while( mBuffers.size() < num ){
+                mBuffers.push_back(std::make_shared<FrameData<T>>());
+            }
+        }
+
+        //same as above but also sizes every buffer ( ie: allocate pixels ) so the first frames don't have to
+        template <typename Init>
+        void reserve(size_t num, Init init){
+            reserve(num);
+            std::unique_lock<std::mutex> lck(mMutex);
+            for(auto & b : mBuffers){
+                init(b->data);
+            }
+        }
+
+        //called on every buffer nobody is leasing each time the pool is searched - for buffers that reference
+        //something ( ie: a decoder picture ) which shouldn't stay pinned once the last lease is gone
+        void setRelease(std::function<void(FrameData<T> &)> release){
+            std::unique_lock<std::mutex> lck(mMutex);
+            mRelease = release;
+        }
+
+        size_t size(){
+            std::unique_lock<std::mutex> lck(mMutex);
+            return mBuffers.size();
+        }
+
+        //buffers still leased out stay valid for their holders
+        void clear(){
+            std::unique_lock<std::mutex> lck(mMutex);
+            mBuffers.clear();
+            mNext = 0;
+        }
+
+    protected:
+        std::mutex mMutex;
+        std::vector <std::shared_ptr<FrameData<T>>> mBuffers;
+        size_t mNext = 0;
+        std::function<void(FrameData<T> &)> mRelease;
+};
+
+};
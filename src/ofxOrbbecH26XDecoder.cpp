@@ -0,0 +1,340 @@
+#include "ofxOrbbecH26XDecoder.h"
+
+namespace ofxOrbbec{
+
+//more than any decoder holds on to - frame threading plus B-frame reordering
+static const size_t kMaxInFlight = 64;
+
+//give up waiting for an IDR after this many packets - some encoders only ever use intra refresh
+static const uint64_t kMaxKeyFrameWait = 120;
+
+H26XDecoder::~H26XDecoder(){
+    close();
+}
+
+void H26XDecoder::setup(const H26XSettings & settings){
+    mSettings = settings;
+}
+
+H26XStats H26XDecoder::getStats(){
+    std::unique_lock<std::mutex> lck(mStatsMutex);
+    return mStats;
+}
+
+bool H26XDecoder::isKeyFrame(const uint8_t * data, size_t size, bool bH264){
+    //walk the Annex B start codes
+    for(size_t i = 0; i + 3 < size; i++){
+        if( data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1 ){
+            continue;
+        }
+        //parameter sets come before the slices so the first non IDR slice settles it without reading the rest
+        uint8_t header = data[i + 3];
+        if( bH264 ){
+            int type = header & 0x1F;
+            if( type == 5 || type == 7 ){
+                return true;
+            }
+            if( type == 1 ){
+                return false;
+            }
+        }else{
+            int type = (header >> 1) & 0x3F;
+            if( ( type >= 16 && type <= 21 ) || ( type >= 32 && type <= 34 ) ){
+                return true;
+            }
+            if( type <= 9 ){
+                return false;
+            }
+        }
+        i += 2;
+    }
+    return false;
+}
+
+#ifdef OFXORBBEC_DECODE_H264_H265
+
+void H26XDecoder::close(){
+    if( mContext ){
+        avcodec_free_context(&mContext);
+    }
+    if( mPacket ){
+        av_packet_free(&mPacket);
+    }
+    if( mFrame ){
+        av_frame_free(&mFrame);
+    }
+    if( mSwsContext ){
+        sws_freeContext(mSwsContext);
+        mSwsContext = nullptr;
+    }
+    mInFlight.clear();
+
+    //a new codec starts from a keyframe with nothing carried over
+    mLastSeq = 0;
+    bWaitForKeyFrame = true;
+    mKeyFrameWait = 0;
+
+    std::unique_lock<std::mutex> lck(mStatsMutex);
+    mStats = H26XStats();
+}
+
+bool H26XDecoder::open(bool bCodecH264){
+    close();
+
+    #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+        avcodec_register_all();
+    #endif
+
+    const AVCodec * codec = avcodec_find_decoder(bCodecH264 ? AV_CODEC_ID_H264 : AV_CODEC_ID_H265);
+    if( !codec ){
+        ofLogError("ofxOrbbec::H26XDecoder") << " no " << ( bCodecH264 ? "H.264" : "H.265" ) << " decoder in this libavcodec build ";
+        return false;
+    }
+
+    mContext = avcodec_alloc_context3(codec);
+    if( !mContext ){
+        return false;
+    }
+
+    //threading has to be set before the codec is opened
+    mContext->thread_count = std::max(mSettings.threadCount, 0);
+    mContext->thread_type = mSettings.threading == H26X_THREADS_SLICE ? FF_THREAD_SLICE : mSettings.threading == H26X_THREADS_FRAME ? FF_THREAD_FRAME : FF_THREAD_FRAME | FF_THREAD_SLICE;
+    if( mSettings.bLowDelay ){
+        mContext->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+
+    if( avcodec_open2(mContext, codec, NULL) < 0 ){
+        ofLogError("ofxOrbbec::H26XDecoder") << " couldn't open the " << ( bCodecH264 ? "H.264" : "H.265" ) << " decoder ";
+        close();
+        return false;
+    }
+
+    //what libavcodec actually settled on can differ from what was asked for
+    std::string active = mContext->active_thread_type == FF_THREAD_FRAME ? "frame" : mContext->active_thread_type == FF_THREAD_SLICE ? "slice" : "no";
+    ofLogNotice("ofxOrbbec::H26XDecoder") << ( bCodecH264 ? "H.264" : "H.265" ) << " decoder open with " << mContext->thread_count << " threads, " << active << " threading" << ( mSettings.bLowDelay ? ", low delay" : "" );
+
+    //reused for every frame
+    mPacket = av_packet_alloc();
+    mFrame = av_frame_alloc();
+    mInFlight.assign(kMaxInFlight, H26XPacket());
+    bH264 = bCodecH264;
+    return true;
+}
+
+bool H26XDecoder::decode(const H26XPacket & packet, PictureCallback onPicture){
+    if( !mContext || bH264 != packet.bH264 ){
+        if( !open(packet.bH264) ){
+            return false;
+        }
+    }
+
+    //anything missing breaks the reference chain - start again from the next keyframe
+    if( packet.seq != mLastSeq + 1 && !bWaitForKeyFrame ){
+        avcodec_flush_buffers(mContext);
+        bWaitForKeyFrame = true;
+        std::unique_lock<std::mutex> lck(mStatsMutex);
+        mStats.delayFrames = 0;
+    }
+    mLastSeq = packet.seq;
+
+    if( bWaitForKeyFrame ){
+        if( isKeyFrame(packet.data, packet.size, packet.bH264) || ++mKeyFrameWait > kMaxKeyFrameWait ){
+            bWaitForKeyFrame = false;
+            mKeyFrameWait = 0;
+        }else{
+            std::unique_lock<std::mutex> lck(mStatsMutex);
+            mStats.numSkipped++;
+            return false;
+        }
+    }
+
+    //the packet only points at the SDK's buffer - libavcodec copies what it needs to keep
+    //pts carries the sequence number through so each picture can be matched to its packet
+    mPacket->data = (uint8_t *)packet.data;
+    mPacket->size = packet.size;
+    mPacket->pts = packet.seq;
+    mPacket->dts = packet.seq;
+
+    auto & slot = mInFlight[packet.seq % mInFlight.size()];
+    slot = packet;
+    slot.data = nullptr;
+    slot.owner.reset();
+
+    int ret = avcodec_send_packet(mContext, mPacket);
+    while( ret == AVERROR(EAGAIN) ){
+        //the decoder's output is full - take what's ready and try again
+        receivePictures(onPicture);
+        ret = avcodec_send_packet(mContext, mPacket);
+    }
+    mPacket->data = nullptr;
+    mPacket->size = 0;
+
+    if( ret < 0 ){
+        std::unique_lock<std::mutex> lck(mStatsMutex);
+        mStats.numErrors++;
+        return false;
+    }
+
+    {
+        std::unique_lock<std::mutex> lck(mStatsMutex);
+        mStats.numPackets++;
+        mStats.delayFrames++;
+    }
+
+    receivePictures(onPicture);
+    return true;
+}
+
+void H26XDecoder::drain(PictureCallback onPicture){
+    if( !mContext ){
+        return;
+    }
+    //a null packet tells the decoder there's nothing more coming so it gives up what it's holding
+    if( avcodec_send_packet(mContext, nullptr) == 0 ){
+        receivePictures(onPicture);
+    }
+    avcodec_flush_buffers(mContext);
+    bWaitForKeyFrame = true;
+
+    std::unique_lock<std::mutex> lck(mStatsMutex);
+    mStats.delayFrames = 0;
+}
+
+//every picture that is ready, not just the first
+void H26XDecoder::receivePictures(PictureCallback & onPicture){
+    while( avcodec_receive_frame(mContext, mFrame) == 0 ){
+        int64_t pts = mFrame->best_effort_timestamp != AV_NOPTS_VALUE ? mFrame->best_effort_timestamp : mFrame->pts;
+
+        H26XPicture picture;
+        picture.frame = mFrame;
+        if( pts != AV_NOPTS_VALUE && pts >= 0 ){
+            const auto & source = mInFlight[pts % mInFlight.size()];
+            picture.seq = source.seq;
+            picture.index = source.index;
+            picture.timeStampUs = source.timeStampUs;
+            picture.systemTimeStampUs = source.systemTimeStampUs;
+            uint64_t nowUs = ofGetElapsedTimeMicros();
+            picture.latencyUs = nowUs > source.pushTimeUs ? nowUs - source.pushTimeUs : 0;
+        }
+
+        {
+            std::unique_lock<std::mutex> lck(mStatsMutex);
+            float latencyMs = picture.latencyUs / 1000.0f;
+            mStats.numPictures++;
+            mStats.delayFrames = std::max(mStats.delayFrames - 1, 0);
+            mStats.lastLatencyMs = latencyMs;
+            mStats.maxLatencyMs = std::max(mStats.maxLatencyMs, latencyMs);
+            mStats.avgLatencyMs = mStats.numPictures == 1 ? latencyMs : ofLerp(mStats.avgLatencyMs, latencyMs, 0.05f);
+        }
+
+        if( onPicture ){
+            onPicture(picture);
+        }
+        av_frame_unref(mFrame);
+    }
+}
+
+bool H26XDecoder::convert(const H26XPicture & picture, ofPixelFormat format, ofPixels & pix){
+    const AVFrame * frame = picture.frame;
+    if( !frame ){
+        return false;
+    }
+
+    AVPixelFormat dstFormat = format == OF_PIXELS_RGBA ? AV_PIX_FMT_RGBA : format == OF_PIXELS_BGR ? AV_PIX_FMT_BGR24 : AV_PIX_FMT_RGB24;
+    H26XScaler scaler = mSettings.scaler;
+    int flags = scaler == H26X_SCALER_POINT ? SWS_POINT : scaler == H26X_SCALER_FAST_BILINEAR ? SWS_FAST_BILINEAR : SWS_BILINEAR;
+    mSwsContext = sws_getCachedContext(mSwsContext, frame->width, frame->height, (AVPixelFormat)frame->format,
+        frame->width, frame->height, dstFormat, flags, NULL, NULL, NULL);
+    if( !mSwsContext ){
+        return false;
+    }
+
+    //convert straight into the output pixels
+    pix.allocate(frame->width, frame->height, format);
+    uint8_t * dst[4] = {pix.getData(), nullptr, nullptr, nullptr};
+    int dstStride[4] = {(int)pix.getBytesStride(), 0, 0, 0};
+    sws_scale(mSwsContext, frame->data, frame->linesize, 0, frame->height, dst, dstStride);
+    return true;
+}
+
+bool H26XDecoder::getPlanes(const H26XPicture & picture, YUVPlanes & planes, std::shared_ptr<void> & owner){
+    if( !picture.frame ){
+        return false;
+    }
+
+    //the frame is allocated the first time an owner is used, after that only its references change
+    AVFrame * ref = static_cast<AVFrame *>(owner.get());
+    if( !ref ){
+        ref = av_frame_alloc();
+        if( !ref ){
+            return false;
+        }
+        owner = std::shared_ptr<AVFrame>(ref, [](AVFrame * frame){ av_frame_free(&frame); });
+    }
+
+    //the decoder's buffers are refcounted - it won't write into one while we hold a reference
+    av_frame_unref(ref);
+    if( av_frame_ref(ref, picture.frame) < 0 ){
+        planes = YUVPlanes();
+        return false;
+    }
+
+    planes.avPixelFormat = ref->format;
+    planes.width = ref->width;
+    planes.height = ref->height;
+    if( ref->format == AV_PIX_FMT_YUV420P || ref->format == AV_PIX_FMT_YUVJ420P ){
+        planes.layout = YUV_PLANES_I420;
+    }else if( ref->format == AV_PIX_FMT_NV12 ){
+        planes.layout = YUV_PLANES_NV12;
+    }else{
+        planes.layout = YUV_PLANES_OTHER;
+    }
+
+    planes.numPlanes = 0;
+    for(int i = 0; i < 3; i++){
+        planes.data[i] = ref->data[i];
+        planes.stride[i] = ref->linesize[i];
+        if( ref->data[i] ){
+            planes.numPlanes++;
+        }
+    }
+    return true;
+}
+
+void H26XDecoder::releasePlanes(YUVPlanes & planes, std::shared_ptr<void> & owner){
+    if( !planes.numPlanes ){
+        return;
+    }
+    if( owner ){
+        av_frame_unref(static_cast<AVFrame *>(owner.get()));
+    }
+    planes = YUVPlanes();
+}
+
+#else
+
+void H26XDecoder::close(){
+}
+
+void H26XDecoder::drain(PictureCallback onPicture){
+}
+
+bool H26XDecoder::decode(const H26XPacket & packet, PictureCallback onPicture){
+    ofLogError("ofxOrbbec::H26XDecoder") << " h264 / h265 not enabled. Define OFXORBBEC_DECODE_H264_H265 or set color format to OB_FORMAT_RGB ";
+    return false;
+}
+
+bool H26XDecoder::convert(const H26XPicture & picture, ofPixelFormat format, ofPixels & pix){
+    return false;
+}
+
+bool H26XDecoder::getPlanes(const H26XPicture & picture, YUVPlanes & planes, std::shared_ptr<void> & owner){
+    return false;
+}
+
+void H26XDecoder::releasePlanes(YUVPlanes & planes, std::shared_ptr<void> & owner){
+}
+
+#endif
+
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <functional>
+
+//If you have ffmpeg / libavcodec included in your project uncomment below
+//You can easily get the required libs from ofxFFmpegRTSP addon ( if you add it to your project )
+#define OFXORBBEC_DECODE_H264_H265
+
+// this allows us to decode the color video streams from Femto Mega over IP connection
+#ifdef OFXORBBEC_DECODE_H264_H265
+    extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavformat/avformat.h>
+    #include <libswscale/swscale.h>
+    #include <libavutil/imgutils.h>
+    }
+#endif
+
+namespace ofxOrbbec{
+
+//swscale filter for the YUV to RGB step - there is no resize so it only changes how chroma is upsampled
+enum H26XScaler{
+    H26X_SCALER_POINT,          //fastest, nearest chroma
+    H26X_SCALER_FAST_BILINEAR,
+    H26X_SCALER_BILINEAR        //what older versions always used
+};
+
+enum H26XThreading{
+    H26X_THREADS_SLICE,             //splits each frame - no added latency but only helps streams encoded with several slices
+    H26X_THREADS_FRAME,             //decodes consecutive frames at once - best throughput, adds threadCount - 1 frames of delay
+    H26X_THREADS_FRAME_AND_SLICE
+};
+
+enum H26XOutput{
+    H26X_OUTPUT_PIXELS,             //converted to colorPixelFormat with swscale - getColorPixels()
+    H26X_OUTPUT_PLANES,             //the decoder's own YUV planes, no conversion at all - getColorPlanesFrame()
+    H26X_OUTPUT_PIXELS_AND_PLANES
+};
+
+struct H26XSettings{
+    H26XScaler scaler = H26X_SCALER_FAST_BILINEAR;
+    int threadCount = 1;            //1 - decode on the calling thread only, 0 - one per core
+    H26XThreading threading = H26X_THREADS_SLICE;
+    bool bLowDelay = false;         //AV_CODEC_FLAG_LOW_DELAY - output every frame as soon as it can be, libavcodec turns frame threading off with it
+    size_t queueSize = 8;           //packets waiting for the decode thread - when it's full the oldest is dropped with its frameset and decoding picks up again at the next keyframe
+    H26XOutput output = H26X_OUTPUT_PIXELS;
+};
+
+enum YUVPlaneLayout{
+    YUV_PLANES_I420,    //Y, U, V - 4:2:0, what the software decoders give for 8-bit streams
+    YUV_PLANES_NV12,    //Y, interleaved UV - 4:2:0
+    YUV_PLANES_OTHER    //anything else ( ie: 10-bit H.265 ) - see avPixelFormat
+};
+
+// A decoded picture's planes as the decoder left them. The pointers are into a referenced AVFrame
+// that FrameData::source keeps alive - read them in place for as long as the lease is held.
+struct YUVPlanes{
+    YUVPlaneLayout layout = YUV_PLANES_OTHER;
+    int avPixelFormat = -1;         //AVPixelFormat
+    int width = 0;
+    int height = 0;
+    int numPlanes = 0;
+    const uint8_t * data[3] = {nullptr, nullptr, nullptr};
+    int stride[3] = {0, 0, 0};      //bytes per row, can be more than the plane width
+};
+
+// One compressed frame. data is only read during decode(), owner keeps it alive until then
+struct H26XPacket{
+    const uint8_t * data = nullptr;
+    size_t size = 0;
+    bool bH264 = true;
+    uint64_t seq = 0;               //consecutive numbering - a gap means packets were dropped before the decoder
+    uint64_t index = 0;             //of the source frame
+    uint64_t timeStampUs = 0;
+    uint64_t systemTimeStampUs = 0;
+    uint64_t pushTimeUs = 0;        //ofGetElapsedTimeMicros() when it was queued for decode
+    std::shared_ptr<void> owner;
+};
+
+// A decoded frame, tagged with the packet it came from - only valid inside the callback
+struct H26XPicture{
+    uint64_t seq = 0;               //of the packet it was decoded from
+    uint64_t index = 0;
+    uint64_t timeStampUs = 0;
+    uint64_t systemTimeStampUs = 0;
+    uint64_t latencyUs = 0;         //packet queued to picture out
+    #ifdef OFXORBBEC_DECODE_H264_H265
+        const AVFrame * frame = nullptr;
+    #endif
+};
+
+struct H26XStats{
+    uint64_t numPackets = 0;
+    uint64_t numPictures = 0;
+    uint64_t numErrors = 0;
+    uint64_t numSkipped = 0;        //packets thrown away waiting for a keyframe after a gap
+    int delayFrames = 0;            //packets sent that haven't come out as pictures yet
+    float lastLatencyMs = 0.0;
+    float avgLatencyMs = 0.0;
+    float maxLatencyMs = 0.0;
+};
+
+// H.264 / H.265 decoder that keeps its codec context, packet, frame and scaler between frames
+// and converts straight into the output pixels. Not thread safe - use one per decoding thread, getStats() is safe from any thread.
+class H26XDecoder{
+    public:
+        typedef std::function<void(const H26XPicture &)> PictureCallback;
+
+        H26XDecoder() = default;
+        H26XDecoder( const H26XDecoder & A) = delete;
+        ~H26XDecoder();
+
+        //takes effect the next time the codec is opened
+        void setup(const H26XSettings & settings);
+
+        //sends the packet then calls onPicture for every picture the decoder has ready - none, one or several with frame threading
+        bool decode(const H26XPacket & packet, PictureCallback onPicture);
+
+        //end of stream - calls onPicture for every picture still held back ( frame threading / reordering ). The next decode waits for a keyframe
+        void drain(PictureCallback onPicture);
+
+        //picture to OF_PIXELS_RGB, OF_PIXELS_BGR or OF_PIXELS_RGBA. pix is only reallocated when the size / format changes
+        bool convert(const H26XPicture & picture, ofPixelFormat format, ofPixels & pix);
+
+        //no copy - takes a reference on the picture's buffers, which owner holds until it's released or reused.
+        //owner must be empty or one this has filled before - its AVFrame is kept and only the reference swapped
+        bool getPlanes(const H26XPicture & picture, YUVPlanes & planes, std::shared_ptr<void> & owner);
+        //drops the picture reference getPlanes() took but keeps owner's AVFrame for next time
+        static void releasePlanes(YUVPlanes & planes, std::shared_ptr<void> & owner);
+
+        //frees the codec - the next decode opens it again
+        void close();
+
+        H26XStats getStats();
+
+        //IDR / parameter sets for H.264, IRAP / parameter sets for H.265 - somewhere decoding can start from
+        static bool isKeyFrame(const uint8_t * data, size_t size, bool bH264);
+
+    protected:
+        H26XSettings mSettings;
+
+        std::mutex mStatsMutex;
+        H26XStats mStats;
+        uint64_t mLastSeq = 0;
+        bool bWaitForKeyFrame = true;
+        uint64_t mKeyFrameWait = 0;
+
+        #ifdef OFXORBBEC_DECODE_H264_H265
+            bool open(bool bH264);
+            void receivePictures(PictureCallback & onPicture);
+
+            AVCodecContext * mContext = nullptr;
+            AVPacket * mPacket = nullptr;
+            AVFrame * mFrame = nullptr;
+            SwsContext * mSwsContext = nullptr;
+            bool bH264 = true;
+
+            //the packets still inside the decoder, looked up by the pts they were sent with
+            std::vector <H26XPacket> mInFlight;
+        #endif
+};
+
+};
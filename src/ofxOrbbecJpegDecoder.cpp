@@ -0,0 +1,101 @@
+#include "ofxOrbbecJpegDecoder.h"
+
+namespace ofxOrbbec{
+
+JpegDecoder::~JpegDecoder(){
+    #ifdef OFXORBBEC_USE_TURBOJPEG
+        if( mHandle ){
+            tjDestroy(mHandle);
+            mHandle = nullptr;
+        }
+    #endif
+}
+
+size_t JpegDecoder::getScaledSize(size_t size, int scale){
+    //libjpeg rounds scaled sizes up
+    return (size + scale - 1) / scale;
+}
+
+bool JpegDecoder::isAvailable(){
+    #if defined(OFXORBBEC_USE_TURBOJPEG) || ( !defined(TARGET_OSX) && !defined(TARGET_WIN32) )
+        return true;
+    #else
+        return false;
+    #endif
+}
+
+#ifdef OFXORBBEC_USE_TURBOJPEG
+
+bool JpegDecoder::decode(const uint8_t * data, size_t size, int scale, ofPixelFormat format, ofPixels & pix){
+    if( !mHandle ){
+        mHandle = tjInitDecompress();
+        if( !mHandle ){
+            ofLogError("ofxOrbbec::JpegDecoder") << " couldn't create turbojpeg decompressor ";
+            return false;
+        }
+    }
+
+    int width, height, subsamp, colorspace;
+    if( tjDecompressHeader3(mHandle, data, size, &width, &height, &subsamp, &colorspace) != 0 ){
+        ofLogError("ofxOrbbec::JpegDecoder") << " bad MJPG header: " << tjGetErrorStr2(mHandle);
+        return false;
+    }
+
+    size_t w = getScaledSize(width, scale);
+    size_t h = getScaledSize(height, scale);
+    int pixelFormat = TJPF_RGB;
+    if( format == OF_PIXELS_RGBA ){
+        pixelFormat = TJPF_RGBA;
+    }else if( format == OF_PIXELS_BGR ){
+        pixelFormat = TJPF_BGR;
+    }else if( format == OF_PIXELS_GRAY ){
+        pixelFormat = TJPF_GRAY;
+    }
+
+    pix.allocate(w, h, format);
+    //asking for the scaled size makes turbojpeg pick the matching DCT scaling factor
+    if( tjDecompress2(mHandle, data, size, pix.getData(), w, pix.getBytesStride(), h, pixelFormat, 0) != 0 ){
+        ofLogError("ofxOrbbec::JpegDecoder") << " MJPG decode failed: " << tjGetErrorStr2(mHandle);
+        return false;
+    }
+    return true;
+}
+
+#else
+
+bool JpegDecoder::decode(const uint8_t * data, size_t size, int scale, ofPixelFormat format, ofPixels & pix){
+#if !defined(TARGET_OSX) && !defined(TARGET_WIN32)
+    bool bGray = format == OF_PIXELS_GRAY;
+    int flags = bGray ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+    if( scale == 2 ){
+        flags = bGray ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2;
+    }else if( scale == 4 ){
+        flags = bGray ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4;
+    }else if( scale == 8 ){
+        flags = bGray ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8;
+    }
+
+    //decoding into a persistent mat lets OpenCV reuse its allocation
+    cv::Mat rawMat(1, size, CV_8UC1, (void *)data);
+    cv::imdecode(rawMat, flags, &mDecodeMat);
+    if( mDecodeMat.empty() ){
+        return false;
+    }
+
+    pix.allocate(mDecodeMat.cols, mDecodeMat.rows, format);
+    cv::Mat dstMat(mDecodeMat.rows, mDecodeMat.cols, format == OF_PIXELS_RGBA ? CV_8UC4 : bGray ? CV_8UC1 : CV_8UC3, pix.getData());
+    if( format == OF_PIXELS_BGR || bGray ){
+        mDecodeMat.copyTo(dstMat);
+    }else{
+        cv::cvtColor(mDecodeMat, dstMat, format == OF_PIXELS_RGBA ? cv::COLOR_BGR2RGBA : cv::COLOR_BGR2RGB);
+    }
+    return true;
+#else
+    ofLogError("ofxOrbbec::JpegDecoder") << " MJPG needs libjpeg-turbo on this platform - remove OFXORBBEC_USE_OPENCV_JPEG or set color format to OB_FORMAT_RGB ";
+    return false;
+#endif
+}
+
+#endif
+
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ofMain.h"
+#include <opencv2/opencv.hpp>
+
+//MJPG is decoded with libjpeg-turbo - addon_config.mk defines this and links libturbojpeg.
+//Define OFXORBBEC_USE_OPENCV_JPEG to go through cv::imdecode instead, which isn't available on macOS / Windows
+#if !defined(OFXORBBEC_USE_OPENCV_JPEG) && !defined(OFXORBBEC_USE_TURBOJPEG)
+    #define OFXORBBEC_USE_TURBOJPEG
+#endif
+#if defined(OFXORBBEC_USE_OPENCV_JPEG) && defined(OFXORBBEC_USE_TURBOJPEG)
+    #undef OFXORBBEC_USE_TURBOJPEG
+#endif
+
+#ifdef OFXORBBEC_USE_TURBOJPEG
+    #include <turbojpeg.h>
+#endif
+
+namespace ofxOrbbec{
+
+// MJPG decoder that keeps its decompressor between frames and writes straight into the output pixels.
+// Not thread safe - use one per decoding thread.
+class JpegDecoder{
+    public:
+
+        JpegDecoder() = default;
+        JpegDecoder( const JpegDecoder & A) = delete;
+        ~JpegDecoder();
+
+        //scale is 1, 2, 4 or 8 - the downscale happens in the DCT so smaller decodes are much cheaper.
+        //format is OF_PIXELS_RGB, OF_PIXELS_BGR, OF_PIXELS_RGBA or OF_PIXELS_GRAY ( IR ). pix is only reallocated when the size / format changes
+        bool decode(const uint8_t * data, size_t size, int scale, ofPixelFormat format, ofPixels & pix);
+
+        //size of a decode at 1 / scale
+        static size_t getScaledSize(size_t size, int scale);
+
+        //false when the decoder compiled in can't decode MJPG on this platform
+        static bool isAvailable();
+
+    protected:
+        #ifdef OFXORBBEC_USE_TURBOJPEG
+            tjhandle mHandle = nullptr;
+        #else
+            cv::Mat mDecodeMat;
+        #endif
+};
+
+};
@@ -0,0 +1,214 @@
+#include "ofxOrbbecProfileNegotiator.h"
+#include "ofxOrbbecJpegDecoder.h"   //which MJPG decoder is compiled in
+
+#include <cmath>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+namespace ofxOrbbec{
+
+struct FormatCost{
+    OBFormat format;
+    float bytesPerPixel;    //on the link - typical rates for the compressed formats
+    float hostNsPerPixel;   //rough per pixel cost of our conversion to the output on one desktop core
+};
+
+#ifdef OFXORBBEC_USE_TURBOJPEG
+    static const float kMJPGNsPerPixel = 4.0f;     //libjpeg-turbo straight into the output, 4:2:2
+#else
+    static const float kMJPGNsPerPixel = 6.5f;     //cv::imdecode to BGR, then cvtColor / copy into the output
+#endif
+
+//formats we can't convert aren't listed
+static const std::vector <FormatCost> kColorCosts = {
+    {OB_FORMAT_RGB,  3.0f,  0.15f},  //copy ( free with bColorZeroCopy )
+    {OB_FORMAT_NV21, 1.5f,  0.35f},  //SIMD YUV
+    {OB_FORMAT_YUYV, 2.0f,  0.4f},
+    {OB_FORMAT_YUY2, 2.0f,  0.4f},
+    {OB_FORMAT_UYVY, 2.0f,  0.4f},
+    {OB_FORMAT_MJPG, 0.3f,  kMJPGNsPerPixel},
+    {OB_FORMAT_H264, 0.05f, 6.0f},   //libavcodec + swscale
+    {OB_FORMAT_H265, 0.04f, 8.0f},
+};
+
+static const std::vector <FormatCost> kDepthCosts = {
+    {OB_FORMAT_Y16,  2.0f,   0.5f},
+    //packed and compressed formats are unpacked to Y16 by the SDK on the host first
+    {OB_FORMAT_Y14,  1.75f,  1.5f},
+    {OB_FORMAT_Y12,  1.5f,   1.5f},
+    {OB_FORMAT_Y11,  1.375f, 1.5f},
+    {OB_FORMAT_Y10,  1.25f,  1.5f},
+    {OB_FORMAT_RLE,  0.8f,   2.5f},
+    {OB_FORMAT_RVL,  0.6f,   3.0f},
+};
+
+static const std::vector <FormatCost> kIRCosts = {
+    {OB_FORMAT_Y8,   1.0f,   0.1f},
+    {OB_FORMAT_Y16,  2.0f,   0.5f},
+    {OB_FORMAT_Y12,  1.5f,   1.5f},
+    {OB_FORMAT_Y10,  1.25f,  1.5f},
+    {OB_FORMAT_MJPG, 0.3f,   kMJPGNsPerPixel},
+};
+
+static const FormatCost * findCost(OBSensorType sensor, OBFormat format, bool bH26X, bool bMJPG){
+    const std::vector <FormatCost> & table = sensor == OB_SENSOR_COLOR ? kColorCosts : sensor == OB_SENSOR_DEPTH ? kDepthCosts : kIRCosts;
+    if( !bH26X && ( format == OB_FORMAT_H264 || format == OB_FORMAT_H265 ) ){
+        return nullptr;
+    }
+    if( !bMJPG && format == OB_FORMAT_MJPG ){
+        return nullptr;
+    }
+    for(auto & c : table){
+        if( c.format == format ){
+            return &c;
+        }
+    }
+    return nullptr;
+}
+
+std::string getFormatName(OBFormat format){
+    switch(format){
+        case OB_FORMAT_YUYV: return "YUYV";
+        case OB_FORMAT_YUY2: return "YUY2";
+        case OB_FORMAT_UYVY: return "UYVY";
+        case OB_FORMAT_NV12: return "NV12";
+        case OB_FORMAT_NV21: return "NV21";
+        case OB_FORMAT_MJPG: return "MJPG";
+        case OB_FORMAT_H264: return "H264";
+        case OB_FORMAT_H265: return "H265";
+        case OB_FORMAT_Y16: return "Y16";
+        case OB_FORMAT_Y8: return "Y8";
+        case OB_FORMAT_Y10: return "Y10";
+        case OB_FORMAT_Y11: return "Y11";
+        case OB_FORMAT_Y12: return "Y12";
+        case OB_FORMAT_Y14: return "Y14";
+        case OB_FORMAT_RLE: return "RLE";
+        case OB_FORMAT_RVL: return "RVL";
+        case OB_FORMAT_RGB: return "RGB";
+        case OB_FORMAT_BGR: return "BGR";
+        case OB_FORMAT_BGRA: return "BGRA";
+        case OB_FORMAT_RGBA: return "RGBA";
+        case OB_FORMAT_I420: return "I420";
+        default: return "format " + std::to_string((int)format);
+    }
+}
+
+float getLinkBudgetMBs(const std::string & connectionType){
+    //roughly what's left for streaming after protocol overhead
+    if( connectionType.find("Ethernet") != std::string::npos ){
+        return 100.0f;
+    }
+    if( connectionType.find("USB1") != std::string::npos ){
+        return 1.0f;
+    }
+    if( connectionType.find("USB2") != std::string::npos ){
+        return 35.0f;
+    }
+    return 350.0f;
+}
+
+std::string ProfileChoice::toString() const{
+    std::stringstream ss;
+    if( profile ){
+        ss << profile->width() << "x" << profile->height() << " " << getFormatName(profile->format()) << " @ " << profile->fps() << "fps";
+        ss << " - " << hostCostMs << " ms/s CPU, " << bandwidthMBs << " MB/s - ";
+    }
+    ss << reason;
+    return ss.str();
+}
+
+ProfileChoice negotiateProfile(std::shared_ptr<ob::StreamProfileList> profiles, OBSensorType sensor, const ProfileRequest & request, float linkBudgetMBs, bool bH26X, bool bMJPG){
+    ProfileChoice best;
+    if( !profiles ){
+        best.reason = "no profiles";
+        return best;
+    }
+
+    //no size asked for - aim for the device's default ( first ) profile size rather than the cheapest tiny one
+    int targetWidth = request.width;
+    int targetHeight = request.height;
+    if( targetWidth <= 0 && profiles->count() > 0 && profiles->getProfile(0)->is<ob::VideoStreamProfile>() ){
+        auto defaultProfile = profiles->getProfile(0)->as<ob::VideoStreamProfile>();
+        targetWidth = defaultProfile->width();
+        targetHeight = defaultProfile->height();
+    }
+
+    //lower is better, compared in order
+    typedef std::tuple <float, float, int, int, float> Score;
+    Score bestScore;
+    size_t numUsable = 0;
+    float requestArea = (float)targetWidth * (targetHeight > 0 ? targetHeight : targetWidth * 9 / 16);
+
+    for(uint32_t i = 0; i < profiles->count(); i++){
+        auto sp = profiles->getProfile(i);
+        if( !sp || !sp->is<ob::VideoStreamProfile>() ){
+            continue;
+        }
+        auto vsp = sp->as<ob::VideoStreamProfile>();
+        const FormatCost * cost = findCost(sensor, vsp->format(), bH26X, bMJPG);
+        if( !cost ){
+            continue;
+        }
+        numUsable++;
+
+        float pixelsPerSec = (float)vsp->width() * vsp->height() * vsp->fps();
+        float hostCostMs = pixelsPerSec * cost->hostNsPerPixel / 1000000.0f;
+        float bandwidthMBs = pixelsPerSec * cost->bytesPerPixel / 1000000.0f;
+
+        float resolutionMiss = 0.0;
+        if( targetWidth > 0 ){
+            bool bMatch = (int)vsp->width() == targetWidth && ( targetHeight <= 0 || (int)vsp->height() == targetHeight );
+            if( !bMatch ){
+                resolutionMiss = 1.0f + std::fabs((float)vsp->width() * vsp->height() - requestArea) / std::max(requestArea, 1.0f);
+            }
+        }
+
+        //too slow is a miss, faster than asked only costs a little
+        float fpsMiss = 0.0;
+        if( request.frameRate > 0 ){
+            int fps = vsp->fps();
+            fpsMiss = fps >= request.frameRate ? ( fps - request.frameRate ) * 0.001f : (float)( request.frameRate - fps );
+        }
+
+        int formatMiss = request.format != OB_FORMAT_UNKNOWN && vsp->format() != request.format ? 1 : 0;
+        int overBudget = bandwidthMBs > linkBudgetMBs ? 1 : 0;
+
+        Score score(resolutionMiss, fpsMiss, formatMiss, overBudget, hostCostMs);
+        if( !best.profile || score < bestScore ){
+            bestScore = score;
+            best.profile = vsp;
+            best.hostCostMs = hostCostMs;
+            best.bandwidthMBs = bandwidthMBs;
+        }
+    }
+
+    if( !best.profile ){
+        best.reason = "none of the " + std::to_string(profiles->count()) + " profiles use a format we can convert";
+        return best;
+    }
+
+    std::stringstream ss;
+    if( std::get<0>(bestScore) > 0.0 ){
+        ss << "no " << targetWidth << ( targetHeight > 0 ? "x" + std::to_string(targetHeight) : " wide" ) << " profile, closest size. ";
+    }
+    if( std::get<1>(bestScore) >= 1.0 ){
+        ss << "no " << request.frameRate << "fps profile at this size. ";
+    }
+    if( std::get<2>(bestScore) ){
+        ss << getFormatName(request.format) << " not available at this size / rate. ";
+    }
+    if( std::get<3>(bestScore) ){
+        ss << "needs more than the link's " << linkBudgetMBs << " MB/s - expect dropped frames. ";
+    }
+    if( ss.str().empty() ){
+        ss << ( request.format != OB_FORMAT_UNKNOWN ? "requested format" : "cheapest to convert" ) << " of the " << numUsable << " usable profiles";
+        if( request.width <= 0 ){
+            ss << " at the default size";
+        }
+    }
+    best.reason = ss.str();
+    return best;
+}
+
+};
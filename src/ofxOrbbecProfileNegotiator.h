@@ -0,0 +1,37 @@
+#pragma once
+
+#include "libobsensor/ObSensor.hpp"
+
+#include <memory>
+#include <string>
+
+namespace ofxOrbbec{
+
+struct ProfileRequest{
+    int width = 0;                          //0 - the device's default size
+    int height = 0;                         //0 - any with that width
+    OBFormat format = OB_FORMAT_UNKNOWN;    //OB_FORMAT_UNKNOWN - whichever is cheapest to convert
+    int frameRate = 30;                     //0 - any
+};
+
+struct ProfileChoice{
+    std::shared_ptr<ob::VideoStreamProfile> profile;
+    float hostCostMs = 0.0;     //estimated CPU ms per second of stream for our conversion
+    float bandwidthMBs = 0.0;   //estimated link bandwidth
+    std::string reason;         //why this profile was picked and what, if anything, didn't match the request
+
+    std::string toString() const;
+};
+
+//bytes / second the link can sustain for streaming - from ob::DeviceInfo::connectionType()
+float getLinkBudgetMBs(const std::string & connectionType);
+
+std::string getFormatName(OBFormat format);
+
+// Scores every profile in the list and picks the one that best gives the requested output, in this order of importance:
+// resolution, frame rate, an explicitly requested format, fitting in linkBudgetMBs, then the lowest host side conversion cost.
+// Conversion costs come from a built-in table of per pixel estimates for each format this addon can convert.
+// bH26X / bMJPG say whether H.264 / H.265 and MJPG can be decoded. Returns an empty profile if nothing in the list is usable.
+ProfileChoice negotiateProfile(std::shared_ptr<ob::StreamProfileList> profiles, OBSensorType sensor, const ProfileRequest & request, float linkBudgetMBs, bool bH26X, bool bMJPG);
+
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxOrbbecThreadUtils.h"
+
+#include <condition_variable>
+
+namespace ofxOrbbec{
+
+enum DropPolicy{
+    DROP_OLDEST,    //a full queue discards its oldest job to make room - lowest latency
+    DROP_NEWEST     //a full queue rejects the incoming job - keeps the jobs already queued
+};
+
+// A processing stage with its own thread and a bounded queue of jobs.
+// Lets one stream ( ie: a slow MJPG decode ) run at its own rate without stalling the others.
+template <typename Job>
+class StreamWorker : public ofThread{
+    public:
+        typedef std::function<void(Job &)> Callback;
+
+        ~StreamWorker(){
+            stop();
+        }
+
+        void start(const std::string & name, size_t queueSize, DropPolicy policy, const ThreadSettings & threadSettings, Callback callback){
+            stop();
+            mName = name;
+            mThreadSettings = threadSettings;
+            mQueue.assign(std::max((size_t)1, queueSize), Job());
+            mPolicy = policy;
+            mCallback = callback;
+            mNumDropped = 0;
+            startThread();
+        }
+
+        void stop(){
+            if( isThreadRunning() ){
+                stopThread();
+                mCondition.notify_all();
+                waitForThread(false, 2000);
+            }
+            std::unique_lock<std::mutex> lck(mQueueMutex);
+            for(auto & job : mQueue){
+                job = Job();
+            }
+            mHead = mCount = 0;
+        }
+
+        //called from the capture thread - never blocks
+        void push(const Job & job){
+            {
+                std::unique_lock<std::mutex> lck(mQueueMutex);
+                if( mQueue.empty() ){
+                    return;
+                }
+                if( mCount == mQueue.size() ){
+                    mNumDropped++;
+                    if( mPolicy == DROP_NEWEST ){
+                        return;
+                    }
+                    mQueue[mHead] = Job();
+                    mHead = (mHead + 1) % mQueue.size();
+                    mCount--;
+                }
+                mQueue[(mHead + mCount) % mQueue.size()] = job;
+                mCount++;
+            }
+            mCondition.notify_one();
+        }
+
+        uint64_t getNumDropped() const{
+            return mNumDropped;
+        }
+
+        const std::string & getName() const{
+            return mName;
+        }
+
+        ThreadStats getThreadStats() const{
+            return mThreadHandle.getStats();
+        }
+
+    protected:
+        void threadedFunction() override{
+            mThreadHandle.setup(mName, mThreadSettings);
+
+            while(isThreadRunning()){
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lck(mQueueMutex);
+                    mCondition.wait_for(lck, std::chrono::milliseconds(20), [this]{ return mCount > 0 || !isThreadRunning(); });
+                    if( mCount == 0 ){
+                        continue;
+                    }
+                    job = std::move(mQueue[mHead]);
+                    mQueue[mHead] = Job();
+                    mHead = (mHead + 1) % mQueue.size();
+                    mCount--;
+                }
+                if( mCallback ){
+                    mCallback(job);
+                }
+            }
+        }
+
+        std::string mName;
+        ThreadSettings mThreadSettings;
+        ThreadHandle mThreadHandle;
+        DropPolicy mPolicy = DROP_OLDEST;
+        Callback mCallback;
+
+        std::mutex mQueueMutex;
+        std::condition_variable mCondition;
+        //fixed size ring so pushing and popping never allocates
+        std::vector <Job> mQueue;
+        size_t mHead = 0;
+        size_t mCount = 0;
+        std::atomic <uint64_t> mNumDropped {0};
+};
+
+};
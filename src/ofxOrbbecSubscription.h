@@ -0,0 +1,144 @@
+#pragma once
+
+#include "ofxOrbbecStreamWorker.h"
+
+namespace ofxOrbbec{
+
+enum SubscriptionMode{
+    SUBSCRIBE_LATEST,   //only the newest frame is kept - for display
+    SUBSCRIBE_QUEUE     //FIFO of up to queueSize frames - for recorders / analytics that need every frame
+};
+
+struct SubscriptionSettings{
+    SubscriptionMode mode = SUBSCRIBE_LATEST;
+
+    //SUBSCRIBE_QUEUE only
+    size_t queueSize = 8;
+    DropPolicy dropPolicy = DROP_OLDEST;    //what to drop when the queue is full and we don't block ( or the block times out )
+    bool bBlockWhenFull = false;            //wait for the consumer to make room instead of dropping - on the subscription's own delivery thread,
+                                            //so capture and the other consumers never wait. Frames queue there ( queueSize more, then dropPolicy )
+    uint64_t blockTimeoutMs = 50;           //upper bound on each wait so a stuck consumer still drops frames
+
+    //this consumer reads FrameSetData::depthFloat - float depth is only computed while someone wants it
+    bool bDepthFloat = false;
+    //this consumer reads decoded color - with Settings::bDecodeColorOnDemand compressed color is only decoded while someone wants it, false keeps it off
+    bool bColor = true;
+};
+
+// One consumer's view of the published frames, with its own queue and drop counters.
+template <typename T>
+class Subscription{
+    public:
+
+        Subscription(const SubscriptionSettings & settings, const std::string & deliveryThreadName = "ofxOrbbec delivery"){
+            mSettings = settings;
+            size_t size = settings.mode == SUBSCRIBE_QUEUE ? std::max((size_t)1, settings.queueSize) : 1;
+            mQueue.assign(size, T());
+
+            //a consumer we may wait on gets its own thread to wait on it
+            if( isBlocking() ){
+                mDelivery.start(deliveryThreadName, size, settings.dropPolicy, ThreadSettings(), [this](T & item){
+                    deliver(item);
+                });
+            }
+        }
+
+        ~Subscription(){
+            mDelivery.stop();
+        }
+
+        //consumer side - false if nothing is waiting
+        bool tryReceive(T & item){
+            std::unique_lock<std::mutex> lck(mMutex);
+            return popLocked(item);
+        }
+
+        //consumer side - blocks until a frame arrives or timeoutMs passes
+        bool receive(T & item, uint64_t timeoutMs){
+            std::unique_lock<std::mutex> lck(mMutex);
+            mReceiveCondition.wait_for(lck, std::chrono::milliseconds(timeoutMs), [this]{ return mCount > 0; });
+            return popLocked(item);
+        }
+
+        size_t size(){
+            std::unique_lock<std::mutex> lck(mMutex);
+            return mCount;
+        }
+
+        uint64_t getNumDelivered() const{
+            return mNumDelivered;
+        }
+
+        //frames this consumer never saw
+        uint64_t getNumDropped() const{
+            return mNumDropped + mDelivery.getNumDropped();
+        }
+
+        const SubscriptionSettings & getSettings() const{
+            return mSettings;
+        }
+
+        //producer side - never waits, bBlockWhenFull subscriptions wait on their delivery thread
+        void push(const T & item){
+            if( isBlocking() ){
+                mDelivery.push(item);
+                return;
+            }
+            deliver(item);
+        }
+
+    protected:
+        bool isBlocking() const{
+            return mSettings.mode == SUBSCRIBE_QUEUE && mSettings.bBlockWhenFull;
+        }
+
+        void deliver(const T & item){
+            {
+                std::unique_lock<std::mutex> lck(mMutex);
+                if( mCount == mQueue.size() && isBlocking() ){
+                    mSpaceCondition.wait_for(lck, std::chrono::milliseconds(mSettings.blockTimeoutMs), [this]{ return mCount < mQueue.size(); });
+                }
+                if( mCount == mQueue.size() ){
+                    mNumDropped++;
+                    if( mSettings.mode == SUBSCRIBE_QUEUE && mSettings.dropPolicy == DROP_NEWEST ){
+                        return;
+                    }
+                    mQueue[mHead] = T();
+                    mHead = (mHead + 1) % mQueue.size();
+                    mCount--;
+                }
+                mQueue[(mHead + mCount) % mQueue.size()] = item;
+                mCount++;
+            }
+            mReceiveCondition.notify_one();
+        }
+
+        bool popLocked(T & item){
+            if( mCount == 0 ){
+                return false;
+            }
+            item = std::move(mQueue[mHead]);
+            mQueue[mHead] = T();
+            mHead = (mHead + 1) % mQueue.size();
+            mCount--;
+            mNumDelivered++;
+            mSpaceCondition.notify_one();
+            return true;
+        }
+
+        SubscriptionSettings mSettings;
+
+        std::mutex mMutex;
+        std::condition_variable mReceiveCondition;
+        std::condition_variable mSpaceCondition;
+        std::vector <T> mQueue;
+        size_t mHead = 0;
+        size_t mCount = 0;
+
+        std::atomic <uint64_t> mNumDelivered {0};
+        std::atomic <uint64_t> mNumDropped {0};
+
+        StreamWorker <T> mDelivery;
+};
+
+};
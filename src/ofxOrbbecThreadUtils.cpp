@@ -0,0 +1,167 @@
+#include "ofxOrbbecThreadUtils.h"
+
+#if defined(TARGET_OSX)
+    #include <pthread.h>
+#elif !defined(TARGET_WIN32)
+    #include <sched.h>
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace ofxOrbbec{
+
+#if !defined(TARGET_WIN32) && !defined(TARGET_OSX)
+//linux thread names are limited to 15 chars - names are "<prefix> <role>[ <index>]" so cut the prefix down and keep the part that tells threads apart
+static std::string getShortThreadName(const std::string & name){
+    const size_t maxLength = 15;
+    if( name.size() <= maxLength ){
+        return name;
+    }
+    size_t split = name.find(' ');
+    if( split == std::string::npos ){
+        return name.substr(0, maxLength);
+    }
+    std::string role = name.substr(split);
+    if( role.size() >= maxLength ){
+        return role.substr(role.size() - maxLength);
+    }
+    return name.substr(0, maxLength - role.size()) + role;
+}
+#endif
+
+void ThreadHandle::setup(const std::string & name, const ThreadSettings & settings){
+    reset();
+    mName = name;
+
+#if defined(TARGET_WIN32)
+    //GetCurrentThread is a pseudo handle - duplicate it so other threads can query it
+    DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &mThread, 0, FALSE, DUPLICATE_SAME_ACCESS);
+
+    std::wstring wName(name.begin(), name.end());
+    SetThreadDescription(GetCurrentThread(), wName.c_str());
+
+    if( settings.cpuAffinity.size() ){
+        DWORD_PTR mask = 0;
+        for(auto cpu : settings.cpuAffinity){
+            mask |= ((DWORD_PTR)1 << cpu);
+        }
+        if( !SetThreadAffinityMask(GetCurrentThread(), mask) ){
+            ofLogWarning("ofxOrbbec::ThreadHandle") << name << " couldn't set cpu affinity";
+        }
+    }
+    if( settings.bRealtime ){
+        if( !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) ){
+            ofLogWarning("ofxOrbbec::ThreadHandle") << name << " couldn't set realtime priority";
+        }
+    }
+
+#elif defined(TARGET_OSX)
+    mThread = pthread_mach_thread_np(pthread_self());
+    pthread_setname_np(name.c_str());
+
+    if( settings.cpuAffinity.size() ){
+        ofLogWarning("ofxOrbbec::ThreadHandle") << " cpu affinity is not supported on macOS";
+    }
+    if( settings.bRealtime ){
+        sched_param param;
+        param.sched_priority = ofClamp(settings.priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+        if( pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0 ){
+            ofLogWarning("ofxOrbbec::ThreadHandle") << name << " couldn't set SCHED_FIFO priority";
+        }
+    }
+
+#else
+    pthread_getcpuclockid(pthread_self(), &mClock);
+    pthread_setname_np(pthread_self(), getShortThreadName(name).c_str());
+
+    if( settings.cpuAffinity.size() ){
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for(auto cpu : settings.cpuAffinity){
+            CPU_SET(cpu, &cpus);
+        }
+        if( pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0 ){
+            ofLogWarning("ofxOrbbec::ThreadHandle") << name << " couldn't set cpu affinity";
+        }
+    }
+    if( settings.bRealtime ){
+        sched_param param;
+        param.sched_priority = ofClamp(settings.priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+        if( pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0 ){
+            ofLogWarning("ofxOrbbec::ThreadHandle") << name << " couldn't set SCHED_FIFO priority - needs CAP_SYS_NICE or an rtprio limit";
+        }
+    }else if( settings.priority != 0 ){
+        //on linux nice values are per thread
+        if( setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), settings.priority) != 0 ){
+            ofLogWarning("ofxOrbbec::ThreadHandle") << name << " couldn't set nice value " << settings.priority;
+        }
+    }
+#endif
+
+    mStartTimeMicros = ofGetElapsedTimeMicros();
+    mStartCpuTimeMs = 0.0;
+    mStartCpuTimeMs = getCpuTimeMs();
+    bSetup.store(true, std::memory_order_release);
+}
+
+bool ThreadHandle::isSetup() const{
+    return bSetup.load(std::memory_order_acquire);
+}
+
+void ThreadHandle::reset(){
+    bSetup = false;
+#if defined(TARGET_WIN32)
+    if( mThread ){
+        CloseHandle(mThread);
+        mThread = nullptr;
+    }
+#endif
+}
+
+double ThreadHandle::getCpuTimeMs() const{
+#if defined(TARGET_WIN32)
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if( !GetThreadTimes(mThread, &creationTime, &exitTime, &kernelTime, &userTime) ){
+        return 0.0;
+    }
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernelTime.dwLowDateTime;
+    k.HighPart = kernelTime.dwHighDateTime;
+    u.LowPart = userTime.dwLowDateTime;
+    u.HighPart = userTime.dwHighDateTime;
+    //100ns units
+    return (k.QuadPart + u.QuadPart) / 10000.0 - mStartCpuTimeMs;
+#elif defined(TARGET_OSX)
+    thread_basic_info_data_t info;
+    mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+    if( thread_info(mThread, THREAD_BASIC_INFO, (thread_info_t)&info, &count) != KERN_SUCCESS ){
+        return 0.0;
+    }
+    double ms = (info.user_time.seconds + info.system_time.seconds) * 1000.0;
+    ms += (info.user_time.microseconds + info.system_time.microseconds) / 1000.0;
+    return ms - mStartCpuTimeMs;
+#else
+    timespec ts;
+    if( clock_gettime(mClock, &ts) != 0 ){
+        return 0.0;
+    }
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0 - mStartCpuTimeMs;
+#endif
+}
+
+ThreadStats ThreadHandle::getStats() const{
+    ThreadStats stats;
+    if( !isSetup() ){
+        return stats;
+    }
+    stats.name = mName;
+    stats.cpuTimeMs = getCpuTimeMs();
+    stats.wallTimeMs = (ofGetElapsedTimeMicros() - mStartTimeMicros) / 1000.0;
+    if( stats.wallTimeMs > 0.0 ){
+        stats.cpuUsage = stats.cpuTimeMs / stats.wallTimeMs;
+    }
+    return stats;
+}
+
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ofMain.h"
+
+#if defined(TARGET_WIN32)
+    #include <windows.h>
+#elif defined(TARGET_OSX)
+    #include <mach/mach.h>
+#else
+    #include <pthread.h>
+    #include <time.h>
+#endif
+
+namespace ofxOrbbec{
+
+struct ThreadSettings{
+    std::vector <int> cpuAffinity;  //cores the thread may run on - empty is any core ( not supported on macOS )
+    bool bRealtime = false;         //SCHED_FIFO ( linux / mac ) or TIME_CRITICAL ( windows ) - usually needs elevated permissions
+    int priority = 0;               //bRealtime: SCHED_FIFO priority 1 - 99. Otherwise: nice value -20 ( highest ) to 19 ( linux only )
+};
+
+struct ThreadStats{
+    std::string name;
+    double cpuTimeMs = 0.0;     //CPU time the thread has used since it was set up
+    double wallTimeMs = 0.0;    //time since it was set up
+    float cpuUsage = 0.0;       //cpuTimeMs / wallTimeMs - 1.0 is one core fully busy
+};
+
+// Applies name / affinity / priority to the thread that calls setup() and
+// lets any other thread read back how much CPU time it has used.
+class ThreadHandle{
+    public:
+
+        //call from the thread itself
+        void setup(const std::string & name, const ThreadSettings & settings);
+        bool isSetup() const;
+        void reset();
+
+        //safe from any thread
+        ThreadStats getStats() const;
+
+    protected:
+        double getCpuTimeMs() const;
+
+        std::string mName;
+        uint64_t mStartTimeMicros = 0;
+        double mStartCpuTimeMs = 0.0;
+        std::atomic <bool> bSetup {false};
+
+        #if defined(TARGET_WIN32)
+            HANDLE mThread = nullptr;
+        #elif defined(TARGET_OSX)
+            mach_port_t mThread = 0;
+        #else
+            clockid_t mClock;
+        #endif
+};
+
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace ofxOrbbec{
+
+// Lock-free single producer / single consumer handoff.
+// The producer fills back() and calls publish(), the consumer calls update() and reads front().
+// Neither side ever blocks and the consumer only ever sees complete buffers.
+template <typename T>
+class TripleBuffer{
+    public:
+
+        TripleBuffer() = default;
+        TripleBuffer( const TripleBuffer & A) = delete;
+        TripleBuffer & operator=( const TripleBuffer & A) = delete;
+
+        //producer side
+        T & back(){
+            return mBuffers[mBackIndex];
+        }
+
+        //swaps the finished back buffer into the middle slot and marks it as fresh
+        void publish(){
+            mBackIndex = mMiddle.exchange(mBackIndex | kFreshBit, std::memory_order_acq_rel) & kIndexMask;
+        }
+
+        //consumer side - returns true if front() changed
+        bool update(){
+            if( (mMiddle.load(std::memory_order_relaxed) & kFreshBit) == 0 ){
+                return false;
+            }
+            mFrontIndex = mMiddle.exchange(mFrontIndex, std::memory_order_acq_rel) & kIndexMask;
+            return true;
+        }
+
+        const T & front() const{
+            return mBuffers[mFrontIndex];
+        }
+
+        T & front(){
+            return mBuffers[mFrontIndex];
+        }
+
+        //only safe when neither side is running
+        void reset(){
+            for(auto & b : mBuffers){
+                b = T();
+            }
+            mFrontIndex = 0;
+            mMiddle = 1;
+            mBackIndex = 2;
+        }
+
+    protected:
+        static constexpr uint8_t kIndexMask = 0x03;
+        static constexpr uint8_t kFreshBit = 0x04;
+
+        T mBuffers[3];
+        uint8_t mFrontIndex = 0;
+        std::atomic <uint8_t> mMiddle {1};
+        uint8_t mBackIndex = 2;
+};
+
+};
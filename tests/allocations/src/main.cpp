@@ -0,0 +1,165 @@
+#include "ofMain.h"
+#include "ofxOrbbecCamera.h"
+
+#include <cstring>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <new>
+#include <unistd.h>
+
+// Replays a recording and fails if the capture path still allocates once it has warmed up.
+// usage: allocations recording.bag [warmup framesets] [measured framesets]
+// Linux only. Every operator new on every thread is counted except the ones the Orbbec SDK makes itself ( found by walking the stack ),
+// so this covers the capture thread, the stream workers and the decode threads. libjpeg / libavcodec use malloc and aren't seen.
+
+static std::atomic <bool> bCounting {false};
+static std::atomic <uint64_t> numAllocations {0};
+static thread_local bool bInHook = false;
+
+//stacks of the first few allocations are printed so a failure says where it came from
+static const uint64_t kMaxReported = 8;
+static const int kMaxFrames = 48;
+
+static bool isSDKFrame(void * address){
+    Dl_info info;
+    if( !dladdr(address, &info) || !info.dli_fname ){
+        return false;
+    }
+    return strstr(info.dli_fname, "libOrbbecSDK") || strstr(info.dli_fname, "libdepthengine");
+}
+
+static void countAllocation(){
+    if( !bCounting.load(std::memory_order_relaxed) || bInHook ){
+        return;
+    }
+    bInHook = true;
+    void * frames[kMaxFrames];
+    int numFrames = backtrace(frames, kMaxFrames);
+    bool bSDK = false;
+    for(int i = 0; i < numFrames && !bSDK; i++){
+        bSDK = isSDKFrame(frames[i]);
+    }
+    if( !bSDK ){
+        uint64_t n = numAllocations++;
+        if( n < kMaxReported ){
+            //doesn't allocate
+            const char header[] = "--- allocation on the capture path:\n";
+            write(2, header, sizeof(header) - 1);
+            backtrace_symbols_fd(frames, numFrames, 2);
+        }
+    }
+    bInHook = false;
+}
+
+static void * allocate(size_t size){
+    countAllocation();
+    void * ptr = malloc(size ? size : 1);
+    if( !ptr ){
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static void * allocateAligned(size_t size, std::align_val_t align){
+    countAllocation();
+    void * ptr = nullptr;
+    if( posix_memalign(&ptr, std::max((size_t)align, sizeof(void *)), size ? size : 1) != 0 ){
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void * operator new(size_t size){ return allocate(size); }
+void * operator new[](size_t size){ return allocate(size); }
+void * operator new(size_t size, const std::nothrow_t &) noexcept{ countAllocation(); return malloc(size ? size : 1); }
+void * operator new[](size_t size, const std::nothrow_t &) noexcept{ countAllocation(); return malloc(size ? size : 1); }
+void * operator new(size_t size, std::align_val_t align){ return allocateAligned(size, align); }
+void * operator new[](size_t size, std::align_val_t align){ return allocateAligned(size, align); }
+void operator delete(void * ptr) noexcept{ free(ptr); }
+void operator delete[](void * ptr) noexcept{ free(ptr); }
+void operator delete(void * ptr, size_t) noexcept{ free(ptr); }
+void operator delete[](void * ptr, size_t) noexcept{ free(ptr); }
+void operator delete(void * ptr, std::align_val_t) noexcept{ free(ptr); }
+void operator delete[](void * ptr, std::align_val_t) noexcept{ free(ptr); }
+void operator delete(void * ptr, size_t, std::align_val_t) noexcept{ free(ptr); }
+void operator delete[](void * ptr, size_t, std::align_val_t) noexcept{ free(ptr); }
+
+//runs the recording once and returns the allocations seen over numMeasured framesets after numWarmup
+static bool runPass(const std::string & name, ofxOrbbec::Settings settings, size_t numWarmup, size_t numMeasured, uint64_t & allocations){
+    ofxOrbbecCamera cam;
+    if( !cam.open(settings) ){
+        ofLogError("allocations") << name << ": couldn't open " << settings.playbackFile;
+        return false;
+    }
+
+    //latest only - the app side keeps up so nothing queues past what the pools were sized for
+    auto subscription = cam.subscribe();
+
+    ofxOrbbec::FrameSetRef frameSet;
+    size_t numReceived = 0;
+    while( numReceived < numWarmup + numMeasured ){
+        if( numReceived == numWarmup ){
+            numAllocations = 0;
+            bCounting = true;
+        }
+        if( !subscription->receive(frameSet, 2000) ){
+            break;
+        }
+        numReceived++;
+        //the getters lease from the same pools as the framesets
+        auto color = cam.getColorFrame();
+        auto depth = cam.getDepthFrame();
+        auto cloud = cam.getPointCloudFrame();
+    }
+    bCounting = false;
+    allocations = numAllocations;
+
+    frameSet.reset();
+    subscription.reset();
+    cam.close();
+
+    if( numReceived < numWarmup + numMeasured ){
+        ofLogError("allocations") << name << ": the recording ran out after " << numReceived << " framesets";
+        return false;
+    }
+    std::cout << name << ": " << allocations << " allocations over " << numMeasured << " framesets" << std::endl;
+    return true;
+}
+
+//========================================================================
+int main(int argc, char ** argv){
+    if( argc < 2 ){
+        std::cout << "usage: " << argv[0] << " recording.bag [warmup framesets] [measured framesets]" << std::endl;
+        return 1;
+    }
+    ofInit();
+
+    //backtrace loads its unwinder the first time - do it before anything is counted
+    void * frames[4];
+    backtrace(frames, 4);
+
+    size_t numWarmup = argc > 2 ? ofToInt(argv[2]) : 30;
+    size_t numMeasured = argc > 3 ? ofToInt(argv[3]) : 150;
+
+    ofxOrbbec::Settings settings;
+    settings.playbackFile = argv[1];
+    settings.bDepth = true;
+    settings.bDepthRaw = true;
+    settings.bColor = true;
+    settings.bPointCloud = true;
+
+    bool bPass = true;
+    uint64_t allocations = 0;
+
+    bPass &= runPass("inline", settings, numWarmup, numMeasured, allocations) && allocations == 0;
+
+    settings.bThreadedStreams = true;
+    bPass &= runPass("threaded streams", settings, numWarmup, numMeasured, allocations) && allocations == 0;
+
+    //the SDK delivery thread has SDK frames under processFrameSet so it isn't counted - the stream workers still are
+    settings.captureMode = ofxOrbbec::CAPTURE_CALLBACK;
+    bPass &= runPass("callback + threaded streams", settings, numWarmup, numMeasured, allocations) && allocations == 0;
+
+    std::cout << ( bPass ? "PASS" : "FAIL" ) << std::endl;
+    return bPass ? 0 : 1;
+}